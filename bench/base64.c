@@ -0,0 +1,83 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench.h"
+#include "der.h"
+
+// Compares the throughput of the scalar base64 decoder against the one
+// base64_decode() dispatches to, on signatures and on PEM bodies.
+
+static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+// Encodes `len` random bytes, with a line break every `line` characters (0 for none)
+static size_t random_base64(char* out, size_t len, size_t line)
+{
+	size_t j = 0, col = 0;
+
+	for (size_t i = 0; i < len; i += 3)
+	{
+		unsigned long v = (unsigned long)random_byte() << 16 | (unsigned long)random_byte() << 8 | random_byte();
+
+		for (int k = 3; k >= 0; k--)
+		{
+			out[j++] = alphabet[(v >> (6 * k)) & 63];
+
+			if (line != 0 && ++col == line)
+			{
+				out[j++] = '\n';
+				col = 0;
+			}
+		}
+	}
+
+	return j;
+}
+
+int main()
+{
+	static const struct { const char* name; size_t bytes, line; } inputs[] = {
+		{ "signature",    48,  0 },
+		{ "PEM, 1 KB",  1086, 64 },
+		{ "PEM, 1 MB", 1 << 20, 64 },
+		{ "MIME, 1 MB", 1 << 20, 76 },
+	};
+
+	puts("      input |   bytes |      scalar |   dispatched | speedup");
+	puts("------------+---------+-------------+--------------+--------");
+
+	for (size_t i = 0; i < sizeof(inputs) / sizeof(inputs[0]); i++)
+	{
+		size_t bytes = inputs[i].bytes;
+		char* in = malloc(bytes * 2 + 16);
+		unsigned char* out1 = malloc(bytes + 16);
+		unsigned char* out2 = malloc(bytes + 16);
+		size_t len = random_base64(in, bytes, inputs[i].line);
+		int iterations = (int)(200000000 / (len + 1000));
+		double scalar = 1e30, fast = 1e30;
+		size_t n1 = 0, n2 = 0;
+
+		for (int run = 0; run < RUNS; run++)
+		{
+			clock_t start = clock();
+			for (int j = 0; j < iterations; j++)
+				n1 = base64_decode_scalar(in, len, out1);
+			scalar = MIN(scalar, elapsed_us(start, iterations));
+
+			start = clock();
+			for (int j = 0; j < iterations; j++)
+				n2 = base64_decode(in, len, out2);
+			fast = MIN(fast, elapsed_us(start, iterations));
+		}
+
+		// bytes per microsecond is MB/s
+		printf(" %10s | %7zu | %6.0f MB/s | %7.0f MB/s | %5.2fx%s\n", inputs[i].name, len, len / scalar, len / fast,
+		       scalar / fast, n1 == n2 && memcmp(out1, out2, n1) == 0 ? "" : "  (MISMATCH)");
+
+		free(in);
+		free(out1);
+		free(out2);
+	}
+
+	return 0;
+}
@@ -0,0 +1,45 @@
+#ifndef _BENCH_H_
+#define _BENCH_H_
+
+#include <stdint.h>
+#include <time.h>
+
+#include "mp_math.h"
+
+// Helpers shared by all the benchmarks
+
+#define RUNS 5 // best of RUNS, to filter out noise from other processes
+
+static uint64_t rng_state = 0x9E3779B97F4A7C15ull;
+
+static inline unsigned char random_byte(void)
+{
+	rng_state ^= rng_state << 13;
+	rng_state ^= rng_state >> 7;
+	rng_state ^= rng_state << 17;
+
+	return (unsigned char)rng_state;
+}
+
+static inline void random_mp(mp_int* a, int bits)
+{
+	unsigned char buf[2048]; // up to 16384 bits
+	int len = (bits + 7) / 8;
+
+	for (int i = 0; i < len; i++)
+		buf[i] = random_byte();
+
+	// Exact bit length, and odd so that Montgomery reduction applies
+	buf[0] &= (unsigned char)(0xFF >> (len * 8 - bits));
+	buf[0] |= (unsigned char)(0x80 >> (len * 8 - bits));
+	buf[len - 1] |= 1;
+
+	mp_read_unsigned_bin(a, buf, len);
+}
+
+static inline double elapsed_us(clock_t start, int iterations)
+{
+	return (double)(clock() - start) * 1e6 / CLOCKS_PER_SEC / iterations;
+}
+
+#endif
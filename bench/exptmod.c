@@ -0,0 +1,55 @@
+#include <stdio.h>
+
+#include "bench.h"
+
+// Compares the two separate exponentiations of a DSA verification against
+// a single simultaneous one (mp_exptmod2) for the usual (p, q) sizes.
+// bench-exptmod-28bit runs it against a build forced to 28-bit digits.
+
+int main()
+{
+	static const int sizes[][2] = { { 1024, 160 }, { 2048, 224 }, { 2048, 256 }, { 3072, 256 }, { 4096, 256 } };
+
+	mp_int p, g, y, u1, u2, a, b, v;
+	mp_init_multi(&p, &g, &y, &u1, &u2, &a, &b, &v, NULL);
+
+	printf("%d-bit digits\n\n", DIGIT_BIT);
+	puts("  |p| |  |q| | exptmod x2 + mulmod |  exptmod2 | speedup");
+	puts("------+------+---------------------+-----------+--------");
+
+	for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+	{
+		int iterations = 40000 / sizes[i][0];
+		double separate = 1e30, joint = 1e30;
+
+		random_mp(&p, sizes[i][0]);
+		random_mp(&g, sizes[i][0] - 1);
+		random_mp(&y, sizes[i][0] - 1);
+		random_mp(&u1, sizes[i][1]);
+		random_mp(&u2, sizes[i][1]);
+
+		for (int run = 0; run < RUNS; run++)
+		{
+			clock_t start = clock();
+			for (int j = 0; j < iterations; j++)
+			{
+				mp_exptmod(&g, &u1, &p, &a);
+				mp_exptmod(&y, &u2, &p, &b);
+				mp_mulmod(&a, &b, &p, &v);
+			}
+			separate = MIN(separate, elapsed_us(start, iterations));
+
+			start = clock();
+			for (int j = 0; j < iterations; j++)
+				mp_exptmod2(&g, &u1, &y, &u2, &p, &a);
+			joint = MIN(joint, elapsed_us(start, iterations));
+		}
+
+		printf(" %4d | %4d | %16.1f us | %6.1f us | %5.2fx%s\n", sizes[i][0], sizes[i][1], separate, joint,
+		       separate / joint, mp_cmp(&a, &v) == MP_EQ ? "" : "  (MISMATCH)");
+	}
+
+	mp_clear_multi(&p, &g, &y, &u1, &u2, &a, &b, &v, NULL);
+
+	return 0;
+}
@@ -0,0 +1,115 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bench.h"
+#include "sha1.h"
+
+#ifdef SHA1_HAVE_X86
+#include <x86intrin.h>
+#endif
+
+// Throughput of every SHA1 back end the CPU supports, over a buffer that stays
+// in the L2 cache. Cycles are those of the time-stamp counter, which ticks at
+// the nominal frequency rather than the current one.
+
+#define BUFFER_BLOCKS 1024 // 64 KB
+
+typedef void (*sha1_blocks_fn)(uint32_t state[5], const unsigned char* data, size_t blocks);
+
+static void run(const char* name, sha1_blocks_fn fn, const unsigned char* data)
+{
+	int iterations = 2000;
+	double best = 1e30, cycles = 1e30;
+	uint32_t state[5] = { 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0 };
+
+	for (int run = 0; run < RUNS; run++)
+	{
+#ifdef SHA1_HAVE_X86
+		uint64_t tsc = __rdtsc();
+#endif
+		clock_t start = clock();
+		for (int j = 0; j < iterations; j++)
+			fn(state, data, BUFFER_BLOCKS);
+		best = MIN(best, elapsed_us(start, iterations));
+#ifdef SHA1_HAVE_X86
+		cycles = MIN(cycles, (double)(__rdtsc() - tsc) / iterations / (BUFFER_BLOCKS * 64));
+#endif
+	}
+
+	// bytes per microsecond is MB/s
+	if (cycles < 1e30)
+		printf(" %-9s | %6.0f MB/s | %5.2f c/B\n", name, BUFFER_BLOCKS * 64 / best, cycles);
+	else
+		printf(" %-9s | %6.0f MB/s |\n", name, BUFFER_BLOCKS * 64 / best);
+}
+
+// Hashes the buffer as messages of `size` bytes, one by one and with SHA1_multi()
+static void run_multi(size_t size, const unsigned char* data)
+{
+	size_t count = BUFFER_BLOCKS * 64 / size;
+	const unsigned char** msgs = malloc(count * sizeof(*msgs));
+	size_t* lens = malloc(count * sizeof(*lens));
+	SHA1_t* digests = malloc(count * sizeof(*digests));
+	double serial = 1e30, multi = 1e30;
+
+	for (size_t i = 0; i < count; i++)
+	{
+		msgs[i] = data + i * size;
+		lens[i] = size;
+	}
+
+	for (int run = 0; run < RUNS; run++)
+	{
+		clock_t start = clock();
+		for (int j = 0; j < 200; j++)
+			for (size_t i = 0; i < count; i++)
+				SHA1(digests[i], msgs[i], lens[i]);
+		serial = MIN(serial, elapsed_us(start, 200));
+
+		start = clock();
+		for (int j = 0; j < 200; j++)
+			SHA1_multi(digests, msgs, lens, count);
+		multi = MIN(multi, elapsed_us(start, 200));
+	}
+
+	printf(" %5zu B   | %6.0f MB/s | %6.0f MB/s\n", size, count * size / serial, count * size / multi);
+
+	free(msgs);
+	free(lens);
+	free(digests);
+}
+
+int main()
+{
+	unsigned char* data = malloc(BUFFER_BLOCKS * 64);
+
+	for (size_t i = 0; i < BUFFER_BLOCKS * 64; i++)
+		data[i] = random_byte();
+
+	puts(" back end  | throughput | cycles");
+	puts("-----------+------------+-----------");
+
+	run("generic", SHA1_blocks_generic, data);
+
+#ifdef SHA1_HAVE_X86
+	if (__builtin_cpu_supports("ssse3"))
+		run("ssse3", SHA1_blocks_ssse3, data);
+
+	if (__builtin_cpu_supports("sha") && __builtin_cpu_supports("sse4.1"))
+		run("sha-ni", SHA1_blocks_shani, data);
+#endif
+
+	run("dispatch", SHA1_blocks, data);
+
+	puts("");
+	puts(" message   | SHA1       | SHA1_multi");
+	puts("-----------+------------+-----------");
+
+	run_multi(20, data);
+	run_multi(256, data);
+	run_multi(4096, data);
+
+	free(data);
+
+	return 0;
+}
@@ -0,0 +1,74 @@
+#include <stdio.h>
+
+#include "bench.h"
+
+// Compares the baseline squaring against the comba one that mp_sqr() picks,
+// with the comba multiplier as a reference, then times whole exponentiations.
+
+int main()
+{
+	static const int sizes[] = { 1024, 2048, 3072, 4096 };
+
+	mp_int a, b, c, d, e;
+	mp_init_multi(&a, &b, &c, &d, &e, NULL);
+
+	puts("  |a| | s_mp_sqr | mp_mul(a, a) |   mp_sqr | speedup");
+	puts("------+----------+--------------+----------+--------");
+
+	for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+	{
+		int iterations = 20000000 / sizes[i] / sizes[i] * 64;
+		double base = 1e30, mul = 1e30, sqr = 1e30;
+
+		random_mp(&a, sizes[i]);
+
+		for (int run = 0; run < RUNS; run++)
+		{
+			clock_t start = clock();
+			for (int j = 0; j < iterations; j++)
+				s_mp_sqr(&a, &b);
+			base = MIN(base, elapsed_us(start, iterations));
+
+			start = clock();
+			for (int j = 0; j < iterations; j++)
+				mp_mul(&a, &a, &c);
+			mul = MIN(mul, elapsed_us(start, iterations));
+
+			start = clock();
+			for (int j = 0; j < iterations; j++)
+				mp_sqr(&a, &d);
+			sqr = MIN(sqr, elapsed_us(start, iterations));
+		}
+
+		printf(" %4d | %5.2f us | %9.2f us | %5.2f us | %5.2fx%s\n", sizes[i], base, mul, sqr, base / sqr,
+		       mp_cmp(&b, &d) == MP_EQ && mp_cmp(&c, &d) == MP_EQ ? "" : "  (MISMATCH)");
+	}
+
+	puts("");
+	puts("  |p| |  |x| |   mp_exptmod");
+	puts("------+------+-------------");
+
+	for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+	{
+		int iterations = 40000 / sizes[i];
+		double best = 1e30;
+
+		random_mp(&a, sizes[i]);
+		random_mp(&b, sizes[i] - 1);
+		random_mp(&c, 256);
+
+		for (int run = 0; run < RUNS; run++)
+		{
+			clock_t start = clock();
+			for (int j = 0; j < iterations; j++)
+				mp_exptmod(&b, &c, &a, &d);
+			best = MIN(best, elapsed_us(start, iterations));
+		}
+
+		printf(" %4d | %4d | %9.1f us\n", sizes[i], 256, best);
+	}
+
+	mp_clear_multi(&a, &b, &c, &d, &e, NULL);
+
+	return 0;
+}
@@ -0,0 +1,94 @@
+#include <limits.h>
+#include <stdio.h>
+
+#include "bench.h"
+
+// Finds the sizes from which Karatsuba multiplication and squaring beat the
+// comba routines on this machine, and prints the cutoffs to use.
+
+#define MIN_DIGITS 8
+#define MAX_DIGITS 256
+#define STREAK     3 // Karatsuba must win for this many sizes in a row
+
+// Best time of `op` on n-digit operands, with the given cutoff
+static double time_op(int square, mp_int* a, mp_int* b, mp_int* c, int cutoff, int iterations)
+{
+	double best = 1e30;
+
+	KARATSUBA_MUL_CUTOFF = KARATSUBA_SQR_CUTOFF = cutoff;
+
+	for (int run = 0; run < RUNS; run++)
+	{
+		clock_t start = clock();
+		for (int j = 0; j < iterations; j++)
+		{
+			if (square)
+				mp_sqr(a, c);
+			else
+				mp_mul(a, b, c);
+		}
+		best = MIN(best, elapsed_us(start, iterations));
+	}
+
+	return best;
+}
+
+static int tune(int square)
+{
+	mp_int a, b, c, d;
+	mp_init_multi(&a, &b, &c, &d, NULL);
+
+	int found = 0, streak = 0;
+
+	printf("\n%s\n", square ? "squaring" : "multiplication");
+	puts("digits |  bits |     comba | Karatsuba");
+	puts("-------+-------+-----------+----------");
+
+	for (int n = MIN_DIGITS; n <= MAX_DIGITS && streak < STREAK; n++)
+	{
+		int iterations = 1 + 20000000 / (n * n);
+
+		random_mp(&a, n * DIGIT_BIT);
+		random_mp(&b, n * DIGIT_BIT);
+
+		// A cutoff of n runs a single level of Karatsuba on top of the comba routines
+		double comba = time_op(square, &a, &b, &c, INT_MAX, iterations);
+		double karatsuba = time_op(square, &a, &b, &d, n, iterations);
+
+		if (n % 8 == 0 || karatsuba < comba)
+			printf(" %5d | %5d | %6.2f us | %6.2f us%s\n", n, n * DIGIT_BIT, comba, karatsuba,
+			       mp_cmp(&c, &d) == MP_EQ ? "" : "  (MISMATCH)");
+
+		if (karatsuba < comba)
+		{
+			if (streak++ == 0)
+				found = n;
+		}
+		else
+			streak = 0;
+	}
+
+	mp_clear_multi(&a, &b, &c, &d, NULL);
+
+	return streak >= STREAK ? found : INT_MAX;
+}
+
+int main()
+{
+	int mul = tune(0);
+	int sqr = tune(1);
+
+	puts("");
+
+	if (mul == INT_MAX)
+		printf("KARATSUBA_MUL_CUTOFF: never pays off below %d digits\n", MAX_DIGITS);
+	else
+		printf("KARATSUBA_MUL_CUTOFF = %d\n", mul);
+
+	if (sqr == INT_MAX)
+		printf("KARATSUBA_SQR_CUTOFF: never pays off below %d digits\n", MAX_DIGITS);
+	else
+		printf("KARATSUBA_SQR_CUTOFF = %d\n", sqr);
+
+	return 0;
+}
@@ -5,11 +5,17 @@
 #include "dsa-verify.h"
 
 // This is a simple tool that allows anyone to easily verify DSA signatures from
-// the command line
+// the command line. The file is hashed as it is read, so it may be larger than
+// the available memory.
 
+// Reads a small text file, such as the key or the signature
 char* read_file(const char* path, size_t* len)
 {
 	FILE* f = fopen(path, "rb");
+
+	if (f == NULL)
+		return NULL;
+
 	fseek(f, 0, SEEK_END);
 	size_t fsize = ftell(f);
 	fseek(f, 0, SEEK_SET);
@@ -34,12 +40,13 @@ int main(int argc, char* argv[])
 		return -1;
 	}
 
-	size_t file_len;
-	char* file_contents = read_file(argv[1], &file_len);
 	char* public_key = read_file(argv[2], NULL);
 	char* signature = read_file(argv[3], NULL);
+	dsa_pubkey* key = NULL;
+	int ret = DSA_FILE_ERROR;
 
-	int ret = dsa_verify_blob((const unsigned char*)file_contents, file_len, public_key, signature);
+	if (public_key != NULL && signature != NULL && (ret = dsa_pubkey_load(public_key, &key)) == DSA_VERIFICATION_OK)
+		ret = dsa_verify_file(argv[1], key, signature);
 
 	if (ret == DSA_VERIFICATION_OK)
 		puts("Verification OK");
@@ -54,10 +61,11 @@ int main(int argc, char* argv[])
 			case DSA_SIGNATURE_PARAM_ERROR: puts("Signature is invalid!"); break;
 			case DSA_KEY_FORMAT_ERROR: puts("Key format is invalid!"); break;
 			case DSA_SIGNATURE_FORMAT_ERROR: puts("Signature format is invalid!"); break;
+			case DSA_FILE_ERROR: puts("Could not read one of the files!"); break;
 		}
 	}
 
-	free(file_contents);
+	dsa_pubkey_free(key);
 	free(public_key);
 	free(signature);
 
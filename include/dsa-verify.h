@@ -40,9 +40,28 @@ enum
 	DSA_KEY_FORMAT_ERROR       = -2, ///< Invalid public key format
 	DSA_KEY_PARAM_ERROR        = -3, ///< Invalid/missing public key parameters
 	DSA_SIGNATURE_FORMAT_ERROR = -4, ///< Invalid signature format
-	DSA_SIGNATURE_PARAM_ERROR  = -5  ///< Invalid/missing signature parameters
+	DSA_SIGNATURE_PARAM_ERROR  = -5, ///< Invalid/missing signature parameters
+	DSA_FILE_ERROR             = -6  ///< The file could not be read, verification was not performed
 };
 
+/** @brief Opaque handle to a parsed DSA public key, see @ref dsa_pubkey_load() */
+typedef struct dsa_pubkey dsa_pubkey;
+
+/** @brief Opaque handle to a verification in progress, see @ref dsa_verify_init() */
+typedef struct dsa_verify_ctx dsa_verify_ctx;
+
+/** @brief Opaque handle to a pool of worker threads, see @ref dsa_pool_create() */
+typedef struct dsa_pool dsa_pool;
+
+/** @brief A single verification of @ref dsa_verify_parallel() */
+typedef struct
+{
+	dsa_pubkey* key; ///< Public key handle the signature was made with
+	SHA1_t sha1;     ///< SHA1 hash to be verified
+	const char* sig; ///< Null-terminated string with the signature, encoded in base64
+	int result;      ///< Result of the verification, set by @ref dsa_verify_parallel()
+} dsa_verify_item;
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -104,6 +123,403 @@ int dsa_verify_hash(const SHA1_t sha1, const char* pubkey, const char* sig);
  */
 int dsa_verify_hash_der(const SHA1_t sha1, const unsigned char* pubkey, size_t pubkey_len, const unsigned char* sig, size_t sig_len);
 
+/**
+ * Load a public key in PEM form
+ *
+ * Parses the given public key once and returns a handle that can be used to
+ * verify any number of signatures with the `dsa_verify_*_with_key()` family of
+ * functions, skipping all key decoding on every call. The handle must be
+ * released with @ref dsa_pubkey_free() once it is no longer needed.
+ *
+ * @param pubkey  Null-terminated string with the contents of the public key,
+ *                in PEM format.
+ * @param key     Where to store the newly created key handle. Left untouched
+ *                on error.
+ *
+ * @returns Returns 1 (@ref DSA_VERIFICATION_OK) on success or any of
+ * @ref DSA_GENERIC_ERROR, @ref DSA_KEY_FORMAT_ERROR or @ref DSA_KEY_PARAM_ERROR
+ * on error.
+ */
+int dsa_pubkey_load(const char* pubkey, dsa_pubkey** key);
+
+/**
+ * Load a public key in DER form
+ *
+ * Same as @ref dsa_pubkey_load(), but takes the binary DER representation of
+ * the public key instead.
+ *
+ * @param pubkey      Binary DER representation of the public key
+ * @param pubkey_len  Length of the public key
+ * @param key         Where to store the newly created key handle. Left
+ *                    untouched on error.
+ *
+ * @returns Returns 1 (@ref DSA_VERIFICATION_OK) on success or any of
+ * @ref DSA_GENERIC_ERROR or @ref DSA_KEY_PARAM_ERROR on error.
+ */
+int dsa_pubkey_load_der(const unsigned char* pubkey, size_t pubkey_len, dsa_pubkey** key);
+
+/**
+ * Free a public key handle
+ *
+ * Releases all resources held by a key returned by @ref dsa_pubkey_load() or
+ * @ref dsa_pubkey_load_der(). Passing `NULL` is allowed and does nothing.
+ *
+ * @param key  Key handle to be freed
+ */
+void dsa_pubkey_free(dsa_pubkey* key);
+
+/**
+ * Precompute a fixed-base table for the generator of a key
+ *
+ * Builds a comb table for the domain generator `g` that cuts the number of
+ * modular squarings needed for the `g` half of every verification by roughly
+ * a factor of `table_bits`. The table holds `2^table_bits` numbers the size of
+ * `p` and belongs to the domain parameters (p, q, g) of the key, so every key
+ * sharing them through @ref dsa_pubkey_share_params() benefits from it.
+ *
+ * Calling this function again with a different size rebuilds the table. It
+ * must not be called while the key (or any key sharing its parameters) is in
+ * use by another thread.
+ *
+ * @param key         Public key handle
+ * @param table_bits  Base-2 logarithm of the number of table entries, between
+ *                    1 and 16. Pass 0 to use the default size (8).
+ *
+ * @returns Returns 1 (@ref DSA_VERIFICATION_OK) on success or
+ * @ref DSA_GENERIC_ERROR on error.
+ */
+int dsa_pubkey_precompute_g(dsa_pubkey* key, int table_bits);
+
+/**
+ * Enable the fixed-base table for the public value of a key
+ *
+ * Like @ref dsa_pubkey_precompute_g(), but for the public value `y` of this
+ * particular key, which speeds up the other half of every verification. Since
+ * the table only pays off for keys that verify many signatures, it is built
+ * lazily: nothing happens until the key has been used for `min_uses`
+ * verifications, at which point the largest table that fits in `max_bytes`
+ * (up to 2^10 entries) is built during that verification.
+ *
+ * Calling this function again replaces the previous policy and drops the
+ * current table. Since the table may be built from within any verification
+ * call, a key with this option enabled must not be used by several threads at
+ * the same time, other than through @ref dsa_verify_parallel().
+ *
+ * @param key        Public key handle
+ * @param max_bytes  Memory budget for the table, in bytes. Pass 0 to disable
+ *                   the table and release its memory.
+ * @param min_uses   Number of verifications after which the table is built.
+ *                   Pass 0 to build it right away.
+ *
+ * @returns Returns 1 (@ref DSA_VERIFICATION_OK) on success or
+ * @ref DSA_GENERIC_ERROR if the table had to be built immediately and that
+ * failed, or the budget is too small for a useful table.
+ */
+int dsa_pubkey_precompute_y(dsa_pubkey* key, size_t max_bytes, unsigned long min_uses);
+
+/**
+ * Share the domain parameters of two keys
+ *
+ * Makes `key` use the domain parameters (p, q, g) of `from`, together with
+ * everything precomputed for them, such as the table built by
+ * @ref dsa_pubkey_precompute_g(). Both keys must have been generated from the
+ * same parameters. The shared state lives until the last key using it is
+ * freed.
+ *
+ * @param key   Public key handle that will adopt the parameters
+ * @param from  Public key handle whose parameters will be shared
+ *
+ * @returns Returns 1 (@ref DSA_VERIFICATION_OK) on success or
+ * @ref DSA_KEY_PARAM_ERROR if the domain parameters of the keys differ.
+ */
+int dsa_pubkey_share_params(dsa_pubkey* key, dsa_pubkey* from);
+
+/**
+ * Verify a given blob using a pre-parsed public key
+ *
+ * Same as @ref dsa_verify_blob(), but uses a key previously loaded with
+ * @ref dsa_pubkey_load() or @ref dsa_pubkey_load_der().
+ *
+ * @param data      Pointer to the beginning of the data blob
+ * @param data_len  Length of the data blob
+ * @param key       Public key handle
+ * @param sig       Null-terminated string with the signature of the file,
+ *                  encoded in base64.
+ *
+ * @returns Returns 1 (@ref DSA_VERIFICATION_OK) on success, 0 (@ref DSA_VERIFICATION_FAILED)
+ * on verification failure or any of @ref DSA_GENERIC_ERROR, @ref DSA_SIGNATURE_FORMAT_ERROR
+ * or @ref DSA_SIGNATURE_PARAM_ERROR on error.
+ */
+int dsa_verify_blob_with_key(const unsigned char* data, size_t data_len, dsa_pubkey* key, const char* sig);
+
+/**
+ * Verify a given SHA1 hash using a pre-parsed public key
+ *
+ * Same as @ref dsa_verify_hash(), but uses a key previously loaded with
+ * @ref dsa_pubkey_load() or @ref dsa_pubkey_load_der().
+ *
+ * @param sha1  SHA1 hash to be verified
+ * @param key   Public key handle
+ * @param sig   Null-terminated string with the signature of the file,
+ *              encoded in base64.
+ *
+ * @returns Returns 1 (@ref DSA_VERIFICATION_OK) on success, 0 (@ref DSA_VERIFICATION_FAILED)
+ * on verification failure or any of @ref DSA_GENERIC_ERROR, @ref DSA_SIGNATURE_FORMAT_ERROR
+ * or @ref DSA_SIGNATURE_PARAM_ERROR on error.
+ */
+int dsa_verify_hash_with_key(const SHA1_t sha1, dsa_pubkey* key, const char* sig);
+
+/**
+ * Verify a given SHA1 hash & signature in DER form using a pre-parsed public key
+ *
+ * Same as @ref dsa_verify_hash_der(), but uses a key previously loaded with
+ * @ref dsa_pubkey_load() or @ref dsa_pubkey_load_der().
+ *
+ * @param sha1     SHA1 hash to be verified
+ * @param key      Public key handle
+ * @param sig      Binary DER representation of the signature of the file
+ * @param sig_len  Length of the signature
+ *
+ * @returns Returns 1 (@ref DSA_VERIFICATION_OK) on success, 0 (@ref DSA_VERIFICATION_FAILED)
+ * on verification failure or any of @ref DSA_GENERIC_ERROR or @ref DSA_SIGNATURE_PARAM_ERROR
+ * on error.
+ */
+int dsa_verify_hash_der_with_key(const SHA1_t sha1, dsa_pubkey* key, const unsigned char* sig, size_t sig_len);
+
+/**
+ * Verify many SHA1 hashes against a single public key
+ *
+ * Equivalent to calling @ref dsa_verify_hash_with_key() once per item, but
+ * cheaper: all signatures are decoded up front and every `s^-1 mod q` of a
+ * batch is obtained from a single modular inversion. Items are processed in
+ * chunks, so memory use does not grow with `count`.
+ *
+ * When the batch is large enough to pay for them, temporary fixed-base tables
+ * (see @ref dsa_pubkey_precompute_g() and @ref dsa_pubkey_precompute_y()) are
+ * built for the duration of the call for whichever of `g` and `y` has none.
+ * These take up to 2^8 numbers the size of `p` each and leave the key
+ * untouched.
+ *
+ * On CPUs with AVX-512 IFMA, the signatures are checked eight at a time, one
+ * per 64-bit lane of the vector unit. Unless `p` is large enough for the key
+ * itself to use that engine, the call sets up a reduction context and tables
+ * of its own for it, and the key's tables go unused.
+ *
+ * @param key      Public key handle
+ * @param sha1     Array of `count` SHA1 hashes to be verified
+ * @param sigs     Array of `count` null-terminated strings with the signature
+ *                 of each hash, encoded in base64.
+ * @param count    Number of items in the batch
+ * @param results  Array of `count` integers that receives the result of each
+ *                 item, with the same values @ref dsa_verify_hash_with_key()
+ *                 would return for it.
+ *
+ * @returns Returns 1 (@ref DSA_VERIFICATION_OK) if every signature is valid,
+ * 0 (@ref DSA_VERIFICATION_FAILED) if at least one of them is not (check
+ * `results` to find out which) or @ref DSA_GENERIC_ERROR if the batch could
+ * not be processed, in which case the contents of `results` are undefined.
+ */
+int dsa_verify_batch(dsa_pubkey* key, const SHA1_t* sha1, const char* const* sigs, size_t count, int* results);
+
+/**
+ * Verify many blobs against a single public key
+ *
+ * Equivalent to calling @ref dsa_verify_blob_with_key() once per item. The
+ * blobs are hashed side by side, several per vector register on CPUs with
+ * AVX2 or AVX-512 (a big win for many small blobs), and the hashes are then
+ * checked by @ref dsa_verify_batch().
+ *
+ * @param key       Public key handle
+ * @param data      Array of `count` pointers to the beginning of each blob
+ * @param data_len  Array of `count` lengths, one per blob
+ * @param sigs      Array of `count` null-terminated strings with the signature
+ *                  of each blob, encoded in base64.
+ * @param count     Number of items in the batch
+ * @param results   Array of `count` integers that receives the result of each
+ *                  item, with the same values @ref dsa_verify_blob_with_key()
+ *                  would return for it.
+ *
+ * @returns Same as @ref dsa_verify_batch().
+ */
+int dsa_verify_blob_batch(dsa_pubkey* key, const unsigned char* const* data, const size_t* data_len, const char* const* sigs, size_t count, int* results);
+
+/**
+ * Create a pool of worker threads
+ *
+ * The pool keeps its threads around between calls to
+ * @ref dsa_verify_parallel(), so it is meant to be created once and reused.
+ * It must be released with @ref dsa_pool_free() once it is no longer needed.
+ *
+ * @param threads  Number of threads that verify signatures, including the one
+ *                 calling @ref dsa_verify_parallel(). Pass 0 to use one per
+ *                 online processor.
+ * @param pool     Where to store the newly created pool. Left untouched on
+ *                 error.
+ *
+ * @returns Returns 1 (@ref DSA_VERIFICATION_OK) on success or
+ * @ref DSA_GENERIC_ERROR on error.
+ */
+int dsa_pool_create(unsigned int threads, dsa_pool** pool);
+
+/**
+ * Free a pool of worker threads
+ *
+ * Stops all the threads of a pool returned by @ref dsa_pool_create() and
+ * releases its resources. Passing `NULL` is allowed and does nothing.
+ *
+ * @param pool  Pool to be freed
+ */
+void dsa_pool_free(dsa_pool* pool);
+
+/**
+ * Verify many SHA1 hashes in parallel
+ *
+ * Spreads the given verifications over all the threads of the pool, each of
+ * them behaving like @ref dsa_verify_hash_with_key(). Items may use different
+ * keys, and the same key may appear any number of times. Threads that run out
+ * of work take over part of the items left to the others, so the load stays
+ * balanced even when verifications take different amounts of time.
+ *
+ * While the call is in progress, neither the pool nor any of the keys in
+ * `items` may be used by other threads.
+ *
+ * @param pool   Pool of worker threads
+ * @param items  Array of `count` verifications. The `result` field of each
+ *               one receives the value @ref dsa_verify_hash_with_key() would
+ *               return for it.
+ * @param count  Number of items
+ *
+ * @returns Returns 1 (@ref DSA_VERIFICATION_OK) if every signature is valid or
+ * 0 (@ref DSA_VERIFICATION_FAILED) if at least one of them is not (check the
+ * `result` field of each item to find out which).
+ */
+int dsa_verify_parallel(dsa_pool* pool, dsa_verify_item* items, size_t count);
+
+/**
+ * Verify a large blob, hashing it while the signature is being checked
+ *
+ * Same as @ref dsa_verify_blob_with_key(), but half of the big number work
+ * (s^-1 mod q and the power of y) does not depend on the data, so it runs on
+ * a second thread of the pool while the calling one hashes the blob. Only the
+ * power of g is left for after the hash, so for large blobs the call takes
+ * about as long as hashing them. With a pool of a single thread both halves
+ * simply run one after the other.
+ *
+ * While the call is in progress, neither the pool nor the key may be used by
+ * other threads.
+ *
+ * @param pool      Pool of threads created with @ref dsa_pool_create()
+ * @param data      Pointer to the beginning of the data blob
+ * @param data_len  Length of the data blob
+ * @param key       Public key handle
+ * @param sig       Null-terminated string with the signature of the file,
+ *                  encoded in base64.
+ *
+ * @returns Same as @ref dsa_verify_blob_with_key().
+ */
+int dsa_verify_blob_overlap(dsa_pool* pool, const unsigned char* data, size_t data_len, dsa_pubkey* key, const char* sig);
+
+/**
+ * Verify a single SHA1 hash with the lowest latency
+ *
+ * Same as @ref dsa_verify_hash_with_key(), but the exponentiations are split
+ * between two threads of the pool, each one taking half of the bits of both
+ * exponents. This roughly halves the time the call takes, at the cost of some
+ * extra work overall, so it is meant for interactive use rather than for
+ * throughput. The first call with a given key computes g and y raised to a
+ * power of two half the size of q, and keeps them in the key.
+ *
+ * While the call is in progress, neither the pool nor the key may be used by
+ * other threads.
+ *
+ * @param pool  Pool of threads created with @ref dsa_pool_create()
+ * @param sha1  SHA1 hash to be verified
+ * @param key   Public key handle
+ * @param sig   Null-terminated string with the signature of the file,
+ *              encoded in base64.
+ *
+ * @returns Same as @ref dsa_verify_hash_with_key().
+ */
+int dsa_verify_hash_split(dsa_pool* pool, const SHA1_t sha1, dsa_pubkey* key, const char* sig);
+
+/**
+ * Start verifying a blob that is not available all at once
+ *
+ * Streaming counterpart of @ref dsa_verify_blob_with_key(): the data is fed
+ * piece by piece with @ref dsa_verify_update() and the result obtained with
+ * @ref dsa_verify_final(), so verifying a blob takes a constant amount of
+ * memory regardless of its size. The signature is decoded right away, so
+ * malformed signatures are reported before any data is processed.
+ *
+ * The key must outlive the verification. Several verifications may be in
+ * progress at the same time.
+ *
+ * @param ctx  Where to store the newly created verification handle. Left
+ *             untouched on error.
+ * @param key  Public key handle
+ * @param sig  Null-terminated string with the signature of the blob, encoded
+ *             in base64.
+ *
+ * @returns Returns 1 (@ref DSA_VERIFICATION_OK) on success or any of
+ * @ref DSA_GENERIC_ERROR, @ref DSA_SIGNATURE_FORMAT_ERROR or
+ * @ref DSA_SIGNATURE_PARAM_ERROR on error.
+ */
+int dsa_verify_init(dsa_verify_ctx** ctx, dsa_pubkey* key, const char* sig);
+
+/**
+ * Feed the next piece of a blob to a verification
+ *
+ * @param ctx       Verification handle returned by @ref dsa_verify_init()
+ * @param data      Pointer to the next piece of the data blob
+ * @param data_len  Length of the piece, may be 0
+ */
+void dsa_verify_update(dsa_verify_ctx* ctx, const unsigned char* data, size_t data_len);
+
+/**
+ * Finish a verification
+ *
+ * Checks the signature against all the data fed so far and releases the
+ * verification handle, which must not be used afterwards.
+ *
+ * @param ctx  Verification handle returned by @ref dsa_verify_init()
+ *
+ * @returns Returns 1 (@ref DSA_VERIFICATION_OK) on success, 0 (@ref DSA_VERIFICATION_FAILED)
+ * on verification failure or any of @ref DSA_GENERIC_ERROR or @ref DSA_SIGNATURE_PARAM_ERROR
+ * on error.
+ */
+int dsa_verify_final(dsa_verify_ctx* ctx);
+
+/**
+ * Abandon a verification
+ *
+ * Releases a verification handle without checking the signature, for when
+ * the data turns out to be unavailable. Passing `NULL` is allowed and does
+ * nothing.
+ *
+ * @param ctx  Verification handle returned by @ref dsa_verify_init()
+ */
+void dsa_verify_abort(dsa_verify_ctx* ctx);
+
+/**
+ * Verify a file using a pre-parsed public key
+ *
+ * Same as @ref dsa_verify_blob_with_key() on the contents of the file, which
+ * are hashed as they are read instead of being loaded in memory first. Regular
+ * files are mapped a window at a time, anything else (pipes, devices) is read
+ * through a fixed buffer, so memory use stays the same whatever the size of
+ * the file. The file must not be truncated while it is being verified.
+ *
+ * @param path  Path of the file to be verified
+ * @param key   Public key handle
+ * @param sig   Null-terminated string with the signature of the file, encoded
+ *              in base64.
+ *
+ * @returns Returns 1 (@ref DSA_VERIFICATION_OK) on success, 0 (@ref DSA_VERIFICATION_FAILED)
+ * on verification failure or any of @ref DSA_GENERIC_ERROR, @ref DSA_FILE_ERROR,
+ * @ref DSA_SIGNATURE_FORMAT_ERROR or @ref DSA_SIGNATURE_PARAM_ERROR on error.
+ */
+int dsa_verify_file(const char* path, dsa_pubkey* key, const char* sig);
+
 #ifdef __cplusplus
 }
 #endif
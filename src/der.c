@@ -28,6 +28,12 @@
 
 #include "der.h"
 
+// AVX2 decoder for runs of plain base64, picked at runtime
+#if defined(__x86_64__) && defined(__GNUC__)
+	#include <immintrin.h>
+	#define BASE64_HAVE_AVX2
+#endif
+
 #define BASE64_PAD '='
 
 /* ASCII order for BASE 64 decode, 255 in unused character */
@@ -67,13 +73,84 @@ static const unsigned char base64de[] =
 		49,  50,  51, 255, 255, 255, 255, 255
 };
 
-size_t base64_decode(const char* in, size_t inlen, unsigned char* out)
+// Decodes as much of the start of `in` as it can in bulk, returns the number of characters used (a multiple of 4)
+typedef size_t (*base64_bulk_fn)(const char* in, size_t inlen, unsigned char* out);
+
+#ifdef BASE64_HAVE_AVX2
+// Decodes blocks of 32 characters into 24 bytes each, up to the first block with
+// anything but the 64 base64 digits in it (line breaks, padding or garbage), which
+// is left to the scalar loop. Translation and validation follow Mula and Lemire:
+// the two nibbles of every character index small tables whose entries only have
+// common bits for characters outside the alphabet, and a third table gives the
+// offset that turns each range of the alphabet into its 6-bit value.
+__attribute__((target("avx2")))
+static size_t _base64_bulk_avx2(const char* in, size_t inlen, unsigned char* out)
+{
+	const __m256i lut_lo = _mm256_setr_epi8(
+		0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A,
+		0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+	const __m256i lut_hi = _mm256_setr_epi8(
+		0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10,
+		0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+	const __m256i lut_roll = _mm256_setr_epi8(
+		0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0,
+		0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+	const __m256i pack = _mm256_setr_epi8(
+		2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+		2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+	const __m256i mask_2f = _mm256_set1_epi8(0x2F);
+
+	size_t i;
+
+	for (i = 0; inlen - i >= 32; i += 32, out += 24)
+	{
+		__m256i v = _mm256_loadu_si256((const __m256i*)(in + i));
+		__m256i hi_nibbles = _mm256_and_si256(_mm256_srli_epi32(v, 4), mask_2f);
+		__m256i lo_nibbles = _mm256_and_si256(v, mask_2f);
+		__m256i lo = _mm256_shuffle_epi8(lut_lo, lo_nibbles);
+		__m256i hi = _mm256_shuffle_epi8(lut_hi, hi_nibbles);
+
+		if (!_mm256_testz_si256(lo, hi))
+			break;
+
+		// '/' is the only character that shares its high nibble with one of another offset
+		__m256i eq_2f = _mm256_cmpeq_epi8(v, mask_2f);
+		v = _mm256_add_epi8(v, _mm256_shuffle_epi8(lut_roll, _mm256_add_epi8(eq_2f, hi_nibbles)));
+
+		// 4 x 6 bits -> 2 x 12 bits -> 24 bits per 32-bit lane, then 3 bytes of each, big-endian
+		v = _mm256_maddubs_epi16(v, _mm256_set1_epi32(0x01400140));
+		v = _mm256_madd_epi16(v, _mm256_set1_epi32(0x00011000));
+		v = _mm256_shuffle_epi8(v, pack);
+		v = _mm256_permutevar8x32_epi32(v, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 0, 0));
+
+		// 24 bytes, the output is not meant to have room for 32
+		_mm_storeu_si128((__m128i*)out, _mm256_castsi256_si128(v));
+		_mm_storel_epi64((__m128i*)(out + 16), _mm256_extracti128_si256(v, 1));
+	}
+
+	return i;
+}
+#endif
+
+static size_t _base64_decode(const char* in, size_t inlen, unsigned char* out, base64_bulk_fn bulk)
 {
 	size_t j = 0;
 	size_t ignored = 0;
 
 	for (size_t i = 0; i < inlen; i++)
 	{
+		// Whenever a group of 4 characters starts here, take what the bulk decoder can
+		if (bulk != NULL && ((i - ignored) & 0x3) == 0)
+		{
+			size_t done = bulk(in + i, inlen - i, out + j);
+
+			i += done;
+			j += done / 4 * 3;
+
+			if (i == inlen)
+				break;
+		}
+
 		if (in[i] == BASE64_PAD)
 			break;
 
@@ -110,6 +187,22 @@ size_t base64_decode(const char* in, size_t inlen, unsigned char* out)
 	return j;
 }
 
+size_t base64_decode_scalar(const char* in, size_t inlen, unsigned char* out)
+{
+	return _base64_decode(in, inlen, out, NULL);
+}
+
+size_t base64_decode(const char* in, size_t inlen, unsigned char* out)
+{
+#ifdef BASE64_HAVE_AVX2
+	// libgcc checks the CPU (and the OS support for AVX) once, at startup
+	if (__builtin_cpu_supports("avx2"))
+		return _base64_decode(in, inlen, out, _base64_bulk_avx2);
+#endif
+
+	return _base64_decode(in, inlen, out, NULL);
+}
+
 enum ASN1_Type
 {
 	ASN1_Type_EOC               =  0,
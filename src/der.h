@@ -38,7 +38,8 @@
  *
  * Reads base64 data and outputs the binary contents to `out`. Returns 0 on error,
  * or the number of bytes used on success. `out` is expected to be at least
- * `BASE64_DECODE_OUT_SIZE(inlen)` bytes long.
+ * `BASE64_DECODE_OUT_SIZE(inlen)` bytes long. Whitespace is skipped, and on CPUs
+ * with AVX2 the runs of 32 characters between line breaks are decoded in bulk.
  *
  * @param[in]  in     Input base64 data
  * @param[in]  inlen  Length of the base64 data
@@ -50,6 +51,20 @@
  */
 size_t base64_decode(const char* in, size_t inlen, unsigned char* out);
 
+/**
+ * @brief Decode base64 data, one character at a time
+ *
+ * Same as @ref base64_decode(), without the vectorized decoder it uses on CPUs
+ * with AVX2. Meant for benchmarks and for checking the results of the former.
+ *
+ * @param[in]  in     Input base64 data
+ * @param[in]  inlen  Length of the base64 data
+ * @param[out] out    Output array where the decoded data will be stored
+ *
+ * @returns Returns 0 on error, or the number of bytes written on success.
+ */
+size_t base64_decode_scalar(const char* in, size_t inlen, unsigned char* out);
+
 /**
  * @brief Parse a public key in DER format
  *
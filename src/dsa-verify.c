@@ -29,47 +29,332 @@
 #include "der.h"
 #include "dsa-verify.h"
 #include "mp_math.h"
+#include "pool.h"
 
 #define SHA1_IMPLEMENTATION
 #include "sha1.h"
 
 #define MP_OP(op) if ((op) != MP_OKAY) goto error;
 
-static int _dsa_verify_hash(mp_int* hash, mp_int* keyP, mp_int* keyQ, mp_int* keyG, mp_int* keyY, mp_int* r, mp_int* s)
+/** @brief Largest DER signature decoded on the stack, bigger ones go to the heap */
+#define DSA_SIG_STACK_SIZE 256
+
+/** @brief Table size used by @ref dsa_pubkey_precompute_g() when none is given */
+#define DSA_DEFAULT_G_TABLE_BITS 8
+
+/** @brief Largest table @ref dsa_pubkey_precompute_y() builds, no matter the budget */
+#define DSA_MAX_Y_TABLE_BITS 10
+
+/** @brief Number of signatures @ref dsa_verify_batch() decodes and inverts at once */
+#define DSA_BATCH_SIZE 64
+
+/** @brief Largest temporary table @ref dsa_verify_batch() builds for a key without one */
+#define DSA_MAX_BATCH_TABLE_BITS 8
+
+/** @brief Size of the table for g @ref dsa_verify_blob_overlap() builds while hashing, if the key has none */
+#define DSA_OVERLAP_G_TEETH 4
+
+/** @brief How many times faster a verification runs on the lanes of the IFMA engine, roughly */
+#define DSA_LANE_SPEEDUP 3
+
+/** @brief Domain parameters (p, q, g) and everything derived from them, shared between keys */
+typedef struct
+{
+	int refs;       ///< Number of keys using this domain
+	mp_int p, q, g;
+	mp_mod_ctx ctx; ///< Reduction context for p, shared by every verification
+	mp_int g_ctx;   ///< g in the representation of `ctx`
+	mp_comb g_comb; ///< Fixed-base table for g, `g_comb.T` is `NULL` until built
+} dsa_domain;
+
+struct dsa_pubkey
+{
+	dsa_domain* dom;
+	mp_int y;
+	mp_int y_ctx;           ///< y in the representation of `dom->ctx`
+	mp_comb y_comb;         ///< Fixed-base table for y, `y_comb.T` is `NULL` until built
+	size_t y_budget;        ///< Memory the table for y may use, 0 if disabled
+	unsigned long y_after;  ///< Build the table for y once the key has been used this many times
+	unsigned long uses;     ///< Number of verifications performed with this key
+	mp_int g_split;         ///< g raised to 2^split, in the representation of `dom->ctx`
+	mp_int y_split;         ///< y raised to 2^split, likewise
+	int split;              ///< Bit @ref dsa_verify_hash_split() cuts exponents at, 0 until first used
+};
+
+struct dsa_verify_ctx
+{
+	dsa_pubkey* key;
+	mp_int r, s;   ///< Signature, decoded up front
+	SHA1_CTX sha1; ///< Running hash of the data
+};
+
+static void _dsa_domain_release(dsa_domain* dom)
+{
+	if (--dom->refs > 0)
+		return;
+
+	mp_comb_clear(&dom->g_comb);
+	mp_mod_ctx_clear(&dom->ctx);
+	mp_clear_multi(&dom->p, &dom->q, &dom->g, &dom->g_ctx, NULL);
+	free(dom);
+}
+
+static int _dsa_pubkey_build_y(dsa_pubkey* key)
+{
+	dsa_domain* dom = key->dom;
+	int bits = 1;
+
+	// Largest table that fits in the budget, one with a single tooth is useless
+	while (bits < DSA_MAX_Y_TABLE_BITS && mp_comb_size(bits + 1, &dom->ctx) <= key->y_budget)
+		bits++;
+
+	if (bits < 2 || mp_comb_init(&key->y_comb, &key->y, mp_count_bits(&dom->q), bits, &dom->ctx) != MP_OKAY)
+	{
+		// Don't try again on every verification
+		key->y_budget = 0;
+		return DSA_GENERIC_ERROR;
+	}
+
+	return DSA_VERIFICATION_OK;
+}
+
+// g^(2^split) and y^(2^split), with split half the size of q, for dsa_verify_hash_split()
+static int _dsa_pubkey_build_split(dsa_pubkey* key)
+{
+	dsa_domain* dom = key->dom;
+	int split = (mp_count_bits(&dom->q) + 1) / 2;
+
+	MP_OP(mp_copy(&dom->g_ctx, &key->g_split));
+	MP_OP(mp_copy(&key->y_ctx, &key->y_split));
+
+	for (int i = 0; i < split; i++)
+	{
+		MP_OP(s_mp_ctx_sqr(&key->g_split, &dom->ctx, &key->g_split));
+		MP_OP(s_mp_ctx_sqr(&key->y_split, &dom->ctx, &key->y_split));
+	}
+
+	key->split = split;
+
+	return DSA_VERIFICATION_OK;
+
+error:
+	return DSA_GENERIC_ERROR;
+}
+
+static int _dsa_check_signature(dsa_pubkey* key, mp_int* r, mp_int* s)
 {
-	mp_int w, v, u1, u2;
-	MP_OP(mp_init_multi(&w, &v, &u1, &u2, NULL));
+	mp_int* keyQ = &key->dom->q;
 
 	// Check 0 < r < q and 0 < s < q
 	if (mp_iszero(r) == MP_YES || mp_iszero(s) == MP_YES || mp_cmp(r, keyQ) != MP_LT || mp_cmp(s, keyQ) != MP_LT)
-	{
-		mp_clear_multi(&w, &v, &u1, &u2, NULL);
 		return DSA_SIGNATURE_PARAM_ERROR;
-	}
 
-	// w := s^-1 mod q
-	MP_OP(mp_invmod(s, keyQ, &w));
+	return DSA_VERIFICATION_OK;
+}
+
+static void _dsa_pubkey_use(dsa_pubkey* key, unsigned long count)
+{
+	key->uses += count;
+
+	// Build the table for y lazily, once the key turns out to be a hot one
+	if (key->uses >= key->y_after && key->y_budget != 0 && key->y_comb.T == NULL)
+		_dsa_pubkey_build_y(key);
+}
+
+static int _dsa_decode_signature(const char* sig, mp_int* r, mp_int* s)
+{
+	size_t sig_len = strlen(sig);
+
+	// Signatures are tiny, so avoid the heap unless we get something unusual
+	unsigned char sig_stack[DSA_SIG_STACK_SIZE];
+	unsigned char* sig_der = sig_stack;
+
+	if (BASE64_DECODE_OUT_SIZE(sig_len) > sizeof(sig_stack) && (sig_der = malloc(BASE64_DECODE_OUT_SIZE(sig_len))) == NULL)
+		return DSA_GENERIC_ERROR;
+
+	int ret = DSA_VERIFICATION_OK;
+
+	if ((sig_len = base64_decode(sig, sig_len, sig_der)) == 0)
+		ret = DSA_SIGNATURE_FORMAT_ERROR;
+	else if (parse_der_signature(sig_der, sig_len, r, s) == 0)
+		ret = DSA_SIGNATURE_PARAM_ERROR;
+
+	if (sig_der != sig_stack)
+		free(sig_der);
+
+	return ret;
+}
+
+// Second half of the verification, with w = s^-1 mod q already known. Either table may be NULL.
+static int _dsa_verify_inverse(mp_int* hash, dsa_pubkey* key, mp_comb* g_comb, mp_comb* y_comb, mp_int* r, mp_int* w)
+{
+	dsa_domain* dom = key->dom;
+	mp_int* keyQ = &dom->q;
+
+	mp_int v, u1, u2;
+	MP_OP(mp_init_multi(&v, &u1, &u2, NULL));
 
 	// u1 := H(m) * w mod q
-	MP_OP(mp_mulmod(hash, &w, keyQ, &u1));
+	MP_OP(mp_mulmod(hash, w, keyQ, &u1));
 
 	// u2 := r * w mod q
-	MP_OP(mp_mulmod(r, &w, keyQ, &u2));
+	MP_OP(mp_mulmod(r, w, keyQ, &u2));
 
-	// v := g^u1 * y^u2 mod p mod q
-	MP_OP(mp_exptmod(keyG, &u1, keyP, &u1)); // u1 := g^u1 mod p
-	MP_OP(mp_exptmod(keyY, &u2, keyP, &u2)); // u2 := y^u2 mod p
-	MP_OP(mp_mulmod(&u1, &u2, keyP, &v));    // v := u1 * u2 mod p
-	MP_OP(mp_mod(&v, keyQ, &v));             // v := v mod q
+	// v := g^u1 * y^u2 mod p mod q, both powers share a single chain of squarings.
+	// g and y are kept in Montgomery form, so v is converted back exactly once.
+	MP_OP(s_mp_ctx_exptmod2(&dom->g_ctx, g_comb, &u1, &key->y_ctx, y_comb, &u2, &dom->ctx, &v));
+	MP_OP(s_mp_ctx_leave(&v, &dom->ctx, &v));
+	MP_OP(mp_mod(&v, keyQ, &v));
 
 	// Signature is valid if r == v
 	int ret = (mp_cmp(r, &v) == MP_EQ ? DSA_VERIFICATION_OK : DSA_VERIFICATION_FAILED);
-	mp_clear_multi(&w, &v, &u1, &u2, NULL);
+	mp_clear_multi(&v, &u1, &u2, NULL);
+
+	return ret;
+
+error:
+	mp_clear_multi(&v, &u1, &u2, NULL);
+	return DSA_GENERIC_ERROR;
+}
+
+// Rough cost of one exponentiation of a verification, in modular multiplications
+static size_t _dsa_term_cost(int bits, int teeth, size_t* chain)
+{
+	if (teeth == 0)
+	{
+		// Sliding window, one multiplication every 6 bits or so
+		*chain = bits;
+		return bits / 6;
+	}
+
+	*chain = (bits + teeth - 1) / teeth;
+	return *chain;
+}
+
+// Rough cost of a whole batch, building the missing tables with the given number of teeth
+// and verifying `speedup` times faster than one signature at a time
+static size_t _dsa_batch_cost(int bits, int g_teeth, int y_teeth, int teeth, size_t count, size_t speedup)
+{
+	size_t g_chain, y_chain, build = 0;
+
+	if (g_teeth == 0 && teeth != 0)
+	{
+		g_teeth = teeth;
+		build += (size_t)(teeth - 1) * (size_t)((bits + teeth - 1) / teeth) + ((size_t)1 << teeth);
+	}
+
+	if (y_teeth == 0 && teeth != 0)
+	{
+		y_teeth = teeth;
+		build += (size_t)(teeth - 1) * (size_t)((bits + teeth - 1) / teeth) + ((size_t)1 << teeth);
+	}
+
+	size_t mults = _dsa_term_cost(bits, g_teeth, &g_chain) + _dsa_term_cost(bits, y_teeth, &y_chain);
+
+	// Both exponentiations share their chain of squarings
+	return build + count * (mults + (g_chain > y_chain ? g_chain : y_chain)) / speedup;
+}
+
+// Cheapest way through a batch, sets `teeth` to the size of the temporary tables it takes (0 for none)
+static size_t _dsa_batch_plan(int bits, int g_teeth, int y_teeth, size_t count, size_t speedup, int* teeth)
+{
+	size_t best = _dsa_batch_cost(bits, g_teeth, y_teeth, 0, count, speedup);
+	int k;
+
+	*teeth = 0;
+
+	for (k = 2; k <= DSA_MAX_BATCH_TABLE_BITS; k++)
+	{
+		size_t cost = _dsa_batch_cost(bits, g_teeth, y_teeth, k, count, speedup);
+
+		if (cost < best)
+		{
+			best = cost;
+			*teeth = k;
+		}
+	}
+
+	return best;
+}
+
+// The part of a verification that doesn't depend on the data: w := s^-1 mod q and
+// yu2 := y^(r * w) mod p, the latter left in the representation of the domain's context
+static int _dsa_verify_y(dsa_pubkey* key, mp_int* r, mp_int* s, mp_int* w, mp_int* yu2)
+{
+	dsa_domain* dom = key->dom;
+	mp_comb* y_comb = (key->y_comb.T != NULL ? &key->y_comb : NULL);
+	int ret = _dsa_check_signature(key, r, s);
+
+	if (ret != DSA_VERIFICATION_OK)
+		return ret;
+
+	mp_int u2, zero;
+	MP_OP(mp_init_multi(&u2, &zero, NULL));
+
+	// A zero exponent adds nothing to the chain, so this is y^u2 alone
+	if (mp_invmod(s, &dom->q, w) != MP_OKAY ||
+	    mp_mulmod(r, w, &dom->q, &u2) != MP_OKAY ||
+	    s_mp_ctx_exptmod2(&key->y_ctx, y_comb, &u2, &dom->g_ctx, NULL, &zero, &dom->ctx, yu2) != MP_OKAY)
+		ret = DSA_GENERIC_ERROR;
+
+	mp_clear_multi(&u2, &zero, NULL);
+
+	return ret;
+
+error:
+	return DSA_GENERIC_ERROR;
+}
+
+// Rest of the verification once the hash is known, with the results of _dsa_verify_y().
+// The table may be NULL.
+static int _dsa_verify_g(mp_int* hash, dsa_pubkey* key, mp_comb* g_comb, mp_int* r, mp_int* w, mp_int* yu2)
+{
+	dsa_domain* dom = key->dom;
+	mp_int* keyQ = &dom->q;
+
+	mp_int v, u1, zero;
+	MP_OP(mp_init_multi(&v, &u1, &zero, NULL));
+
+	// v := g^u1 * yu2 mod p mod q, with u1 := H(m) * w mod q
+	MP_OP(mp_mulmod(hash, w, keyQ, &u1));
+	MP_OP(s_mp_ctx_exptmod2(&dom->g_ctx, g_comb, &u1, &key->y_ctx, NULL, &zero, &dom->ctx, &v));
+	MP_OP(s_mp_ctx_mul(&v, yu2, &dom->ctx, &v));
+	MP_OP(s_mp_ctx_leave(&v, &dom->ctx, &v));
+	MP_OP(mp_mod(&v, keyQ, &v));
+
+	// Signature is valid if r == v
+	int ret = (mp_cmp(r, &v) == MP_EQ ? DSA_VERIFICATION_OK : DSA_VERIFICATION_FAILED);
+	mp_clear_multi(&v, &u1, &zero, NULL);
+
+	return ret;
+
+error:
+	mp_clear_multi(&v, &u1, &zero, NULL);
+	return DSA_GENERIC_ERROR;
+}
+
+static int _dsa_verify_hash(mp_int* hash, dsa_pubkey* key, mp_int* r, mp_int* s)
+{
+	int ret = _dsa_check_signature(key, r, s);
+
+	if (ret != DSA_VERIFICATION_OK)
+		return ret;
+
+	// w := s^-1 mod q
+	mp_int w;
+	MP_OP(mp_init(&w));
+
+	if (mp_invmod(s, &key->dom->q, &w) != MP_OKAY)
+		ret = DSA_GENERIC_ERROR;
+	else
+		ret = _dsa_verify_inverse(hash, key, (key->dom->g_comb.T != NULL ? &key->dom->g_comb : NULL),
+		                          (key->y_comb.T != NULL ? &key->y_comb : NULL), r, &w);
+
+	mp_clear(&w);
 
 	return ret;
 
 error:
-	mp_clear_multi(&w, &v, &u1, &u2, NULL);
 	return DSA_GENERIC_ERROR;
 }
 
@@ -83,51 +368,217 @@ int dsa_verify_blob(const unsigned char* data, size_t data_len, const char* pubk
 
 int dsa_verify_hash(const SHA1_t sha1, const char* pubkey, const char* sig)
 {
-	SHA1_t sha1sum;
-	SHA1(sha1sum, (const unsigned char*)sha1, sizeof(SHA1_t));
+	dsa_pubkey* key;
+	int ret = dsa_pubkey_load(pubkey, &key);
 
+	if (ret != DSA_VERIFICATION_OK)
+		return ret;
+
+	ret = dsa_verify_hash_with_key(sha1, key, sig);
+	dsa_pubkey_free(key);
+
+	return ret;
+}
+
+int dsa_verify_hash_der(const SHA1_t sha1, const unsigned char* pubkey, size_t pubkey_len, const unsigned char* sig, size_t sig_len)
+{
+	dsa_pubkey* key;
+	int ret = dsa_pubkey_load_der(pubkey, pubkey_len, &key);
+
+	if (ret != DSA_VERIFICATION_OK)
+		return ret;
+
+	ret = dsa_verify_hash_der_with_key(sha1, key, sig, sig_len);
+	dsa_pubkey_free(key);
+
+	return ret;
+}
+
+int dsa_pubkey_load(const char* pubkey, dsa_pubkey** key)
+{
 	size_t key_len = strlen(pubkey);
-	size_t sig_len = strlen(sig);
+	unsigned char* key_der = malloc(BASE64_DECODE_OUT_SIZE(key_len));
+
+	if (key_der == NULL)
+		return DSA_GENERIC_ERROR;
 
 	int ret;
-	unsigned char* key_der = malloc(BASE64_DECODE_OUT_SIZE(key_len));
-	unsigned char* sig_der = malloc(BASE64_DECODE_OUT_SIZE(sig_len));
 
-	if((key_len = pem2der(pubkey, key_len, key_der)) == 0)
-	{
+	if ((key_len = pem2der(pubkey, key_len, key_der)) == 0)
 		ret = DSA_KEY_FORMAT_ERROR;
-		goto error;
+	else
+		ret = dsa_pubkey_load_der(key_der, key_len, key);
+
+	free(key_der);
+
+	return ret;
+}
+
+int dsa_pubkey_load_der(const unsigned char* pubkey, size_t pubkey_len, dsa_pubkey** key)
+{
+	dsa_pubkey* k = malloc(sizeof(dsa_pubkey));
+	dsa_domain* dom = malloc(sizeof(dsa_domain));
+
+	if (k == NULL || dom == NULL || mp_init_multi(&dom->p, &dom->q, &dom->g, &dom->g_ctx, &k->y, &k->y_ctx, &k->g_split, &k->y_split, NULL) != MP_OKAY)
+	{
+		free(k);
+		free(dom);
+		return DSA_GENERIC_ERROR;
 	}
 
-	if((sig_len = base64_decode(sig, sig_len, sig_der)) == 0)
+	if (parse_der_pubkey(pubkey, pubkey_len, &dom->p, &dom->q, &dom->g, &k->y) == 0 || mp_mod_ctx_init(&dom->ctx, &dom->p) != MP_OKAY)
 	{
-		ret = DSA_SIGNATURE_FORMAT_ERROR;
-		goto error;
+		mp_clear_multi(&dom->p, &dom->q, &dom->g, &dom->g_ctx, &k->y, &k->y_ctx, &k->g_split, &k->y_split, NULL);
+		free(k);
+		free(dom);
+		return DSA_KEY_PARAM_ERROR;
 	}
 
-	ret = dsa_verify_hash_der(sha1sum, key_der, key_len, sig_der, sig_len);
+	if (s_mp_ctx_enter(&dom->g, &dom->ctx, &dom->g_ctx) != MP_OKAY || s_mp_ctx_enter(&k->y, &dom->ctx, &k->y_ctx) != MP_OKAY)
+	{
+		mp_mod_ctx_clear(&dom->ctx);
+		mp_clear_multi(&dom->p, &dom->q, &dom->g, &dom->g_ctx, &k->y, &k->y_ctx, &k->g_split, &k->y_split, NULL);
+		free(k);
+		free(dom);
+		return DSA_GENERIC_ERROR;
+	}
 
-error:
-	free(key_der);
-	free(sig_der);
+	dom->refs = 1;
+	dom->g_comb.T = NULL;
+	k->dom = dom;
+	k->y_comb.T = NULL;
+	k->y_budget = 0;
+	k->y_after = 0;
+	k->uses = 0;
+	k->split = 0;
+	*key = k;
 
-	return ret;
+	return DSA_VERIFICATION_OK;
 }
 
-int dsa_verify_hash_der(const SHA1_t sha1, const unsigned char* pubkey, size_t pubkey_len, const unsigned char* sig, size_t sig_len)
+void dsa_pubkey_free(dsa_pubkey* key)
 {
-	// Parse public key
-	mp_int keyP, keyQ, keyG, keyY, r, s, hash;
-	mp_init_multi(&keyP, &keyQ, &keyG, &keyY, &r, &s, &hash, NULL);
+	if (key == NULL)
+		return;
 
-	int ret;
+	_dsa_domain_release(key->dom);
+	mp_comb_clear(&key->y_comb);
+	mp_clear_multi(&key->y, &key->y_ctx, &key->g_split, &key->y_split, NULL);
+	free(key);
+}
+
+int dsa_pubkey_precompute_g(dsa_pubkey* key, int table_bits)
+{
+	dsa_domain* dom = key->dom;
 
-	if (parse_der_pubkey(pubkey, pubkey_len, &keyP, &keyQ, &keyG, &keyY) == 0)
+	if (table_bits == 0)
+		table_bits = DSA_DEFAULT_G_TABLE_BITS;
+
+	if (table_bits < 0 || table_bits > MP_COMB_MAX_TEETH)
+		return DSA_GENERIC_ERROR;
+
+	if (dom->g_comb.T != NULL)
 	{
-		ret = DSA_KEY_PARAM_ERROR;
-		goto error;
+		if (dom->g_comb.teeth == table_bits)
+			return DSA_VERIFICATION_OK;
+
+		mp_comb_clear(&dom->g_comb);
+	}
+
+	// Exponents are reduced mod q, so the table only needs to cover |q| bits
+	if (mp_comb_init(&dom->g_comb, &dom->g, mp_count_bits(&dom->q), table_bits, &dom->ctx) != MP_OKAY)
+		return DSA_GENERIC_ERROR;
+
+	return DSA_VERIFICATION_OK;
+}
+
+int dsa_pubkey_precompute_y(dsa_pubkey* key, size_t max_bytes, unsigned long min_uses)
+{
+	// Any change of policy drops the current table
+	mp_comb_clear(&key->y_comb);
+
+	key->y_budget = max_bytes;
+	key->y_after = min_uses;
+
+	if (max_bytes == 0 || key->uses < min_uses)
+		return DSA_VERIFICATION_OK;
+
+	return _dsa_pubkey_build_y(key);
+}
+
+int dsa_pubkey_share_params(dsa_pubkey* key, dsa_pubkey* from)
+{
+	dsa_domain* dom = from->dom;
+
+	if (key->dom == dom)
+		return DSA_VERIFICATION_OK;
+
+	if (mp_cmp(&key->dom->p, &dom->p) != MP_EQ || mp_cmp(&key->dom->q, &dom->q) != MP_EQ || mp_cmp(&key->dom->g, &dom->g) != MP_EQ)
+		return DSA_KEY_PARAM_ERROR;
+
+	dom->refs++;
+	_dsa_domain_release(key->dom);
+	key->dom = dom;
+	key->split = 0;
+
+	return DSA_VERIFICATION_OK;
+}
+
+int dsa_verify_blob_with_key(const unsigned char* data, size_t data_len, dsa_pubkey* key, const char* sig)
+{
+	SHA1_t sha1sum;
+	SHA1(sha1sum, data, data_len);
+
+	return dsa_verify_hash_with_key(sha1sum, key, sig);
+}
+
+// Reads the key without updating it, so any number of threads may share it
+static int _dsa_verify_sig(const SHA1_t sha1, dsa_pubkey* key, const char* sig)
+{
+	SHA1_t sha1sum;
+	SHA1(sha1sum, (const unsigned char*)sha1, sizeof(SHA1_t));
+
+	mp_int r, s, hash;
+	mp_init_multi(&r, &s, &hash, NULL);
+
+	int ret = _dsa_decode_signature(sig, &r, &s);
+
+	if (ret == DSA_VERIFICATION_OK)
+	{
+		// Read hash, verify data
+		mp_read_unsigned_bin(&hash, sha1sum, sizeof(SHA1_t));
+
+		ret = _dsa_verify_hash(&hash, key, &r, &s);
 	}
 
+	mp_clear_multi(&r, &s, &hash, NULL);
+
+	return ret;
+}
+
+static void _dsa_verify_item(void* arg, size_t index)
+{
+	dsa_verify_item* item = (dsa_verify_item*)arg + index;
+
+	item->result = _dsa_verify_sig(item->sha1, item->key, item->sig);
+}
+
+int dsa_verify_hash_with_key(const SHA1_t sha1, dsa_pubkey* key, const char* sig)
+{
+	_dsa_pubkey_use(key, 1);
+
+	return _dsa_verify_sig(sha1, key, sig);
+}
+
+int dsa_verify_hash_der_with_key(const SHA1_t sha1, dsa_pubkey* key, const unsigned char* sig, size_t sig_len)
+{
+	_dsa_pubkey_use(key, 1);
+
+	mp_int r, s, hash;
+	mp_init_multi(&r, &s, &hash, NULL);
+
+	int ret;
+
 	// Parse signature
 	if (parse_der_signature(sig, sig_len, &r, &s) == 0)
 	{
@@ -138,10 +589,485 @@ int dsa_verify_hash_der(const SHA1_t sha1, const unsigned char* pubkey, size_t p
 	// Read hash, verify data
 	mp_read_unsigned_bin(&hash, sha1, sizeof(SHA1_t));
 
-	ret = _dsa_verify_hash(&hash, &keyP, &keyQ, &keyG, &keyY, &r, &s);
+	ret = _dsa_verify_hash(&hash, key, &r, &s);
 
 error:
-	mp_clear_multi(&keyP, &keyQ, &keyG, &keyY, &r, &s, &hash, NULL);
+	mp_clear_multi(&r, &s, &hash, NULL);
 
 	return ret;
 }
+
+int dsa_verify_batch(dsa_pubkey* key, const SHA1_t* sha1, const char* const* sigs, size_t count, int* results)
+{
+	dsa_domain* dom = key->dom;
+	mp_int* keyQ = &dom->q;
+	size_t chunk = (count < DSA_BATCH_SIZE ? count : DSA_BATCH_SIZE);
+	size_t idx[DSA_BATCH_SIZE];
+	SHA1_t sums[DSA_BATCH_SIZE];
+	const unsigned char* msgs[DSA_BATCH_SIZE];
+	size_t lens[DSA_BATCH_SIZE];
+	size_t i, j, k, m, n, inited = 0;
+	int ret = DSA_VERIFICATION_OK;
+
+	if (count == 0)
+		return DSA_VERIFICATION_OK;
+
+	// One set of numbers per chunk item, reused for the whole batch
+	mp_int acc, g_lane, y_lane;
+	mp_int* r = malloc(4 * chunk * sizeof(mp_int));
+
+	if (r == NULL || mp_init_multi(&acc, &g_lane, &y_lane, NULL) != MP_OKAY)
+	{
+		free(r);
+		return DSA_GENERIC_ERROR;
+	}
+
+	mp_int* s = r + chunk;
+	mp_int* hash = s + chunk;
+	mp_int* w = hash + chunk;
+
+	// Temporary tables for keys without their own, see below
+	mp_comb g_tmp, y_tmp;
+	g_tmp.T = y_tmp.T = NULL;
+
+	// Context the exponentiations run in, and g and y in its representation
+	mp_mod_ctx lane_ctx;
+	mp_mod_ctx* ctx = &dom->ctx;
+	mp_int* g_ctx = &dom->g_ctx;
+	mp_int* y_ctx = &key->y_ctx;
+	int own_tables = 1;
+
+	for (; inited < 4 * chunk; inited++)
+		MP_OP(mp_init(&r[inited]));
+
+	// Signatures made with DSA only carry (g^k mod p) mod q, so they can't be
+	// combined into a single product check. Instead, a large enough batch pays
+	// for temporary fixed-base tables for g and y when the key has none.
+	int bits = mp_count_bits(keyQ), teeth = 0;
+	int g_teeth = (dom->g_comb.T != NULL ? dom->g_comb.teeth : 0);
+	int y_teeth = (key->y_comb.T != NULL ? key->y_comb.teeth : 0);
+	size_t best = _dsa_batch_plan(bits, g_teeth, y_teeth, count, 1, &teeth);
+
+	// Every verification is the same sequence of operations, so with the IFMA
+	// engine several of them run in lockstep, one per lane. Unless the domain
+	// already works on 52-bit limbs that takes a context of its own, where the
+	// tables of the key can't be used.
+	if (count >= MP_R52_LANES && (mp_cpu_kernel() & MP_KERNEL_IFMA) != 0)
+	{
+		if (dom->ctx.mode == MP_REDUCE_MONT_R52)
+		{
+			_dsa_batch_plan(bits, g_teeth, y_teeth, count, DSA_LANE_SPEEDUP, &teeth);
+		}
+		else if (mp_count_bits(&dom->p) <= MP_R52_BIT * MP_R52_LIMBS &&
+		         s_mp_mod_ctx_setup(&lane_ctx, &dom->p, MP_REDUCE_MONT_R52) == MP_OKAY)
+		{
+			int lane_teeth;
+
+			if (_dsa_batch_plan(bits, 0, 0, count, DSA_LANE_SPEEDUP, &lane_teeth) < best &&
+			    s_mp_ctx_enter(&dom->g, &lane_ctx, &g_lane) == MP_OKAY &&
+			    s_mp_ctx_enter(&key->y, &lane_ctx, &y_lane) == MP_OKAY)
+			{
+				ctx = &lane_ctx;
+				g_ctx = &g_lane;
+				y_ctx = &y_lane;
+				teeth = lane_teeth;
+				g_teeth = y_teeth = own_tables = 0;
+			}
+			else
+				mp_mod_ctx_clear(&lane_ctx);
+		}
+	}
+
+	// A failure here only costs speed, the batch goes on without the table
+	if (teeth != 0 && g_teeth == 0)
+		mp_comb_init(&g_tmp, &dom->g, bits, teeth, ctx);
+
+	if (teeth != 0 && y_teeth == 0)
+		mp_comb_init(&y_tmp, &key->y, bits, teeth, ctx);
+
+	for (i = 0; i < count; i += chunk)
+	{
+		size_t len = (count - i < chunk ? count - i : chunk);
+
+		// What is signed is the hash of each hash, computed for the whole chunk side by side
+		for (j = 0; j < len; j++)
+		{
+			msgs[j] = sha1[i + j];
+			lens[j] = sizeof(SHA1_t);
+		}
+
+		SHA1_multi(sums, msgs, lens, len);
+
+		// Decode the whole chunk, keeping only the signatures worth checking
+		for (j = 0, m = 0; j < len; j++)
+		{
+			int* res = &results[i + j];
+
+			if ((*res = _dsa_decode_signature(sigs[i + j], &r[m], &s[m])) != DSA_VERIFICATION_OK ||
+			    (*res = _dsa_check_signature(key, &r[m], &s[m])) != DSA_VERIFICATION_OK)
+				continue;
+
+			MP_OP(mp_read_unsigned_bin(&hash[m], sums[j], sizeof(SHA1_t)));
+
+			idx[m++] = i + j;
+		}
+
+		if (m == 0)
+			continue;
+
+		_dsa_pubkey_use(key, m);
+
+		// Montgomery's trick: w[k] := s[0] * ... * s[k] mod q, so a single
+		// inversion of the whole product yields every s^-1 mod q
+		MP_OP(mp_copy(&s[0], &w[0]));
+
+		for (k = 1; k < m; k++)
+			MP_OP(mp_mulmod(&w[k - 1], &s[k], keyQ, &w[k]));
+
+		if (mp_invmod(&w[m - 1], keyQ, &acc) == MP_OKAY)
+		{
+			// acc holds (s[0] * ... * s[k])^-1, peel one factor off per step
+			for (k = m - 1; k > 0; k--)
+			{
+				MP_OP(mp_mulmod(&acc, &w[k - 1], keyQ, &w[k]));
+				MP_OP(mp_mulmod(&acc, &s[k], keyQ, &acc));
+			}
+
+			mp_exch(&acc, &w[0]);
+		}
+		else
+		{
+			// Only possible with a bogus q, find out which items are to blame
+			for (k = 0; k < m; k++)
+				if (mp_invmod(&s[k], keyQ, &w[k]) != MP_OKAY)
+					results[idx[k]] = DSA_GENERIC_ERROR;
+		}
+
+		// u1 := H(m) * w mod q and u2 := r * w mod q in place of H(m) and w,
+		// packing the items still to check at the front
+		for (k = 0, n = 0; k < m; k++)
+		{
+			if (results[idx[k]] != DSA_VERIFICATION_OK)
+				continue;
+
+			MP_OP(mp_mulmod(&hash[k], &w[k], keyQ, &hash[n]));
+			MP_OP(mp_mulmod(&r[k], &w[k], keyQ, &w[n]));
+			mp_exch(&r[k], &r[n]);
+			idx[n++] = idx[k];
+		}
+
+		// The key may have built its own table for y along the way
+		mp_comb* g_comb = (own_tables && dom->g_comb.T != NULL ? &dom->g_comb : (g_tmp.T != NULL ? &g_tmp : NULL));
+		mp_comb* y_comb = (own_tables && key->y_comb.T != NULL ? &key->y_comb : (y_tmp.T != NULL ? &y_tmp : NULL));
+
+		// v := g^u1 * y^u2 mod p mod q for the whole chunk at once, into s
+		MP_OP(s_mp_ctx_exptmod2_lanes(g_ctx, g_comb, hash, y_ctx, y_comb, w, (int)n, ctx, s));
+
+		for (k = 0; k < n; k++)
+		{
+			MP_OP(s_mp_ctx_leave(&s[k], ctx, &s[k]));
+			MP_OP(mp_mod(&s[k], keyQ, &s[k]));
+
+			// Signature is valid if r == v
+			results[idx[k]] = (mp_cmp(&r[k], &s[k]) == MP_EQ ? DSA_VERIFICATION_OK : DSA_VERIFICATION_FAILED);
+		}
+	}
+
+	for (i = 0; i < count; i++)
+		if (results[i] != DSA_VERIFICATION_OK)
+			ret = DSA_VERIFICATION_FAILED;
+
+	goto cleanup;
+
+error:
+	ret = DSA_GENERIC_ERROR;
+
+cleanup:
+	mp_comb_clear(&g_tmp);
+	mp_comb_clear(&y_tmp);
+
+	if (ctx == &lane_ctx)
+		mp_mod_ctx_clear(&lane_ctx);
+
+	for (i = 0; i < inited; i++)
+		mp_clear(&r[i]);
+
+	mp_clear_multi(&acc, &g_lane, &y_lane, NULL);
+	free(r);
+
+	return ret;
+}
+
+int dsa_verify_blob_batch(dsa_pubkey* key, const unsigned char* const* data, const size_t* data_len, const char* const* sigs, size_t count, int* results)
+{
+	SHA1_t* sha1 = malloc((count != 0 ? count : 1) * sizeof(SHA1_t));
+
+	if (sha1 == NULL)
+		return DSA_GENERIC_ERROR;
+
+	SHA1_multi(sha1, data, data_len, count);
+
+	int ret = dsa_verify_batch(key, (const SHA1_t*)sha1, sigs, count, results);
+
+	free(sha1);
+
+	return ret;
+}
+
+// Both halves of dsa_verify_blob_overlap(), one per pool item
+typedef struct
+{
+	dsa_pubkey* key;
+	const unsigned char* data;
+	size_t data_len;
+	SHA1_t sha1;      ///< Hash of the data, set by item 0
+	mp_int r, s;      ///< Signature, decoded up front
+	mp_int w, yu2;    ///< Set by item 1, see _dsa_verify_y()
+	mp_comb g_tmp;    ///< Table for g built by item 1 if the domain has none
+	int ret;          ///< Result of item 1
+} dsa_overlap;
+
+static void _dsa_overlap_item(void* arg, size_t index)
+{
+	dsa_overlap* o = (dsa_overlap*)arg;
+
+	if (index == 0)
+		SHA1(o->sha1, o->data, o->data_len);
+	else if ((o->ret = _dsa_verify_y(o->key, &o->r, &o->s, &o->w, &o->yu2)) == DSA_VERIFICATION_OK && o->key->dom->g_comb.T == NULL)
+	{
+		// Without a table the power of g is most of the work left after the hash, build a
+		// small one meanwhile. A failure here only costs speed.
+		dsa_domain* dom = o->key->dom;
+		mp_comb_init(&o->g_tmp, &dom->g, mp_count_bits(&dom->q), DSA_OVERLAP_G_TEETH, &dom->ctx);
+	}
+}
+
+int dsa_verify_blob_overlap(dsa_pool* pool, const unsigned char* data, size_t data_len, dsa_pubkey* key, const char* sig)
+{
+	dsa_overlap o;
+	o.key = key;
+	o.data = data;
+	o.data_len = data_len;
+	o.g_tmp.T = NULL;
+
+	if (mp_init_multi(&o.r, &o.s, &o.w, &o.yu2, NULL) != MP_OKAY)
+		return DSA_GENERIC_ERROR;
+
+	int ret = _dsa_decode_signature(sig, &o.r, &o.s);
+
+	if (ret == DSA_VERIFICATION_OK)
+	{
+		// Any table for y is built here, before the key is shared with another thread
+		_dsa_pubkey_use(key, 1);
+
+		pool_run(pool, 2, _dsa_overlap_item, &o);
+
+		if ((ret = o.ret) == DSA_VERIFICATION_OK)
+		{
+			SHA1_t sha1sum;
+			SHA1(sha1sum, o.sha1, sizeof(SHA1_t));
+
+			// s is no longer needed, read the hash into it
+			if (mp_read_unsigned_bin(&o.s, sha1sum, sizeof(SHA1_t)) != MP_OKAY)
+			{
+				ret = DSA_GENERIC_ERROR;
+			}
+			else
+			{
+				mp_comb* g_comb = (key->dom->g_comb.T != NULL ? &key->dom->g_comb : (o.g_tmp.T != NULL ? &o.g_tmp : NULL));
+				ret = _dsa_verify_g(&o.s, key, g_comb, &o.r, &o.w, &o.yu2);
+			}
+		}
+	}
+
+	mp_comb_clear(&o.g_tmp);
+	mp_clear_multi(&o.r, &o.s, &o.w, &o.yu2, NULL);
+
+	return ret;
+}
+
+// Both halves of dsa_verify_hash_split(), one per pool item
+typedef struct
+{
+	mp_mod_ctx* ctx;
+	mp_int* base[2][2];  ///< g and y of each item, in the representation of `ctx`
+	mp_comb* comb[2][2]; ///< Tables for them, may be NULL
+	mp_int x[2][2];      ///< Exponents of each item
+	mp_int v[2];         ///< Result of each item
+	int err[2];
+} dsa_split;
+
+static void _dsa_split_item(void* arg, size_t index)
+{
+	dsa_split* sp = (dsa_split*)arg;
+
+	sp->err[index] = s_mp_ctx_exptmod2(sp->base[index][0], sp->comb[index][0], &sp->x[index][0],
+	                                   sp->base[index][1], sp->comb[index][1], &sp->x[index][1], sp->ctx, &sp->v[index]);
+}
+
+int dsa_verify_hash_split(dsa_pool* pool, const SHA1_t sha1, dsa_pubkey* key, const char* sig)
+{
+	dsa_domain* dom = key->dom;
+	mp_int* keyQ = &dom->q;
+	mp_int r, s, hash, u1, u2;
+	dsa_split sp;
+	int ret, k;
+
+	SHA1_t sha1sum;
+	SHA1(sha1sum, (const unsigned char*)sha1, sizeof(SHA1_t));
+
+	if (mp_init_multi(&r, &s, &hash, &u1, &u2, &sp.x[0][0], &sp.x[0][1], &sp.x[1][0], &sp.x[1][1], &sp.v[0], &sp.v[1], NULL) != MP_OKAY)
+		return DSA_GENERIC_ERROR;
+
+	if ((ret = _dsa_decode_signature(sig, &r, &s)) != DSA_VERIFICATION_OK ||
+	    (ret = _dsa_check_signature(key, &r, &s)) != DSA_VERIFICATION_OK)
+		goto cleanup;
+
+	_dsa_pubkey_use(key, 1);
+
+	if (key->split == 0 && (ret = _dsa_pubkey_build_split(key)) != DSA_VERIFICATION_OK)
+		goto cleanup;
+
+	// u1 := H(m) * w mod q and u2 := r * w mod q, with w := s^-1 mod q
+	if (mp_invmod(&s, keyQ, &u2) != MP_OKAY)
+		goto error;
+
+	MP_OP(mp_read_unsigned_bin(&hash, sha1sum, sizeof(SHA1_t)));
+	MP_OP(mp_mulmod(&hash, &u2, keyQ, &u1));
+	MP_OP(mp_mulmod(&r, &u2, keyQ, &u2));
+
+	// The two powers share their chain of squarings, so handing one to each thread
+	// would barely help. Instead each thread takes half of the bits of both
+	// exponents, the upper ones with the bases raised to 2^split. A base with a
+	// table has a short chain already and goes whole to the first thread.
+	sp.ctx = &dom->ctx;
+	sp.base[0][0] = &dom->g_ctx;
+	sp.base[0][1] = &key->y_ctx;
+	sp.base[1][0] = &key->g_split;
+	sp.base[1][1] = &key->y_split;
+	sp.comb[0][0] = (dom->g_comb.T != NULL ? &dom->g_comb : NULL);
+	sp.comb[0][1] = (key->y_comb.T != NULL ? &key->y_comb : NULL);
+	sp.comb[1][0] = sp.comb[1][1] = NULL;
+
+	for (k = 0; k < 2; k++)
+	{
+		mp_int* u = (k == 0 ? &u1 : &u2);
+
+		if (sp.comb[0][k] != NULL)
+		{
+			MP_OP(mp_copy(u, &sp.x[0][k]));
+		}
+		else
+		{
+			MP_OP(mp_mod_2d(u, key->split, &sp.x[0][k]));
+			MP_OP(mp_div_2d(u, key->split, &sp.x[1][k], NULL));
+		}
+	}
+
+	pool_run(pool, 2, _dsa_split_item, &sp);
+
+	if (sp.err[0] != MP_OKAY || sp.err[1] != MP_OKAY)
+		goto error;
+
+	// v := g^u1 * y^u2 mod p mod q
+	MP_OP(s_mp_ctx_mul(&sp.v[0], &sp.v[1], &dom->ctx, &hash));
+	MP_OP(s_mp_ctx_leave(&hash, &dom->ctx, &hash));
+	MP_OP(mp_mod(&hash, keyQ, &hash));
+
+	// Signature is valid if r == v
+	ret = (mp_cmp(&r, &hash) == MP_EQ ? DSA_VERIFICATION_OK : DSA_VERIFICATION_FAILED);
+
+	goto cleanup;
+
+error:
+	ret = DSA_GENERIC_ERROR;
+
+cleanup:
+	mp_clear_multi(&r, &s, &hash, &u1, &u2, &sp.x[0][0], &sp.x[0][1], &sp.x[1][0], &sp.x[1][1], &sp.v[0], &sp.v[1], NULL);
+
+	return ret;
+}
+
+int dsa_verify_parallel(dsa_pool* pool, dsa_verify_item* items, size_t count)
+{
+	size_t i;
+
+	// Account for every use up front, so any table a key decides to build is
+	// ready before the workers start. From then on the keys are only read.
+	for (i = 0; i < count; i++)
+		_dsa_pubkey_use(items[i].key, 1);
+
+	pool_run(pool, count, _dsa_verify_item, items);
+
+	for (i = 0; i < count; i++)
+		if (items[i].result != DSA_VERIFICATION_OK)
+			return DSA_VERIFICATION_FAILED;
+
+	return DSA_VERIFICATION_OK;
+}
+
+int dsa_verify_init(dsa_verify_ctx** ctx, dsa_pubkey* key, const char* sig)
+{
+	dsa_verify_ctx* c = malloc(sizeof(dsa_verify_ctx));
+
+	if (c == NULL || mp_init_multi(&c->r, &c->s, NULL) != MP_OKAY)
+	{
+		free(c);
+		return DSA_GENERIC_ERROR;
+	}
+
+	// Report a broken signature now rather than after hashing the whole data
+	int ret = _dsa_decode_signature(sig, &c->r, &c->s);
+
+	if (ret != DSA_VERIFICATION_OK)
+	{
+		dsa_verify_abort(c);
+		return ret;
+	}
+
+	c->key = key;
+	SHA1_reset(&c->sha1);
+	*ctx = c;
+
+	return DSA_VERIFICATION_OK;
+}
+
+void dsa_verify_update(dsa_verify_ctx* ctx, const unsigned char* data, size_t data_len)
+{
+	if (data_len != 0)
+		SHA1_input(&ctx->sha1, data, data_len);
+}
+
+int dsa_verify_final(dsa_verify_ctx* ctx)
+{
+	SHA1_t sha1, sha1sum;
+	SHA1_result(&ctx->sha1, sha1);
+	SHA1(sha1sum, sha1, sizeof(SHA1_t));
+
+	_dsa_pubkey_use(ctx->key, 1);
+
+	mp_int hash;
+	int ret = DSA_GENERIC_ERROR;
+
+	if (mp_init(&hash) == MP_OKAY)
+	{
+		// Read hash, verify data
+		mp_read_unsigned_bin(&hash, sha1sum, sizeof(SHA1_t));
+
+		ret = _dsa_verify_hash(&hash, ctx->key, &ctx->r, &ctx->s);
+		mp_clear(&hash);
+	}
+
+	dsa_verify_abort(ctx);
+
+	return ret;
+}
+
+void dsa_verify_abort(dsa_verify_ctx* ctx)
+{
+	if (ctx == NULL)
+		return;
+
+	mp_clear_multi(&ctx->r, &ctx->s, NULL);
+	free(ctx);
+}
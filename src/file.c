@@ -0,0 +1,177 @@
+/*
+ *  This file is part of the dsa-verify library (https://github.com/marcizhu/dsa-verify)
+ *
+ *  Copyright (C) 2021 Marc Izquierdo
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200112L
+#define _FILE_OFFSET_BITS 64 // files over 2 GB on 32-bit targets
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "dsa-verify.h"
+
+#ifndef _WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/** @brief Bytes of a regular file mapped at once, a multiple of any page size */
+#define DSA_FILE_WINDOW ((size_t)16 << 20)
+
+/** @brief Size of the buffer files that can't be mapped are read through */
+#define DSA_FILE_BUFFER ((size_t)1 << 20)
+
+#ifdef _WIN32
+static int _dsa_file_hash(const char* path, dsa_verify_ctx* ctx)
+{
+	FILE* f = fopen(path, "rb");
+	unsigned char* buf = malloc(DSA_FILE_BUFFER);
+	int ret = DSA_VERIFICATION_OK;
+	size_t len;
+
+	if (f == NULL || buf == NULL)
+		ret = DSA_FILE_ERROR;
+	else
+	{
+		while ((len = fread(buf, 1, DSA_FILE_BUFFER, f)) != 0)
+			dsa_verify_update(ctx, buf, len);
+
+		if (ferror(f))
+			ret = DSA_FILE_ERROR;
+	}
+
+	if (f != NULL)
+		fclose(f);
+
+	free(buf);
+
+	return ret;
+}
+#else
+// Regular files are mapped one window at a time, so only a window's worth of
+// pages is ever resident no matter the size of the file. Returns how much of
+// the file made it to the verification.
+static off_t _dsa_file_map(int fd, off_t size, dsa_verify_ctx* ctx)
+{
+	off_t offset;
+
+	for (offset = 0; offset < size; offset += (off_t)DSA_FILE_WINDOW)
+	{
+		size_t len = (size - offset < (off_t)DSA_FILE_WINDOW ? (size_t)(size - offset) : DSA_FILE_WINDOW);
+		void* map = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, offset);
+
+		if (map == MAP_FAILED)
+			break;
+
+		posix_madvise(map, len, POSIX_MADV_SEQUENTIAL);
+		dsa_verify_update(ctx, (const unsigned char*)map, len);
+		munmap(map, len);
+	}
+
+	return offset;
+}
+
+// Pipes, devices and anything mmap() refuses go through a fixed buffer, from
+// the current position of the file on
+static int _dsa_file_read(int fd, dsa_verify_ctx* ctx)
+{
+	unsigned char* buf = malloc(DSA_FILE_BUFFER);
+	ssize_t len;
+
+	if (buf == NULL)
+		return DSA_GENERIC_ERROR;
+
+#ifdef POSIX_FADV_SEQUENTIAL
+	// Fails with ESPIPE on pipes, which is fine
+	posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+	while ((len = read(fd, buf, DSA_FILE_BUFFER)) != 0)
+	{
+		if (len < 0)
+		{
+			if (errno == EINTR)
+				continue;
+
+			free(buf);
+			return DSA_FILE_ERROR;
+		}
+
+		dsa_verify_update(ctx, buf, (size_t)len);
+	}
+
+	free(buf);
+
+	return DSA_VERIFICATION_OK;
+}
+
+static int _dsa_file_hash(const char* path, dsa_verify_ctx* ctx)
+{
+	int fd = open(path, O_RDONLY);
+	struct stat st;
+	int ret = DSA_VERIFICATION_OK;
+
+	if (fd < 0)
+		return DSA_FILE_ERROR;
+
+	if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0)
+	{
+		// Whatever could not be mapped is read, starting where the mapping stopped
+		off_t done = _dsa_file_map(fd, st.st_size, ctx);
+
+		if (done < st.st_size && lseek(fd, done, SEEK_SET) != done)
+			ret = DSA_FILE_ERROR;
+		else if (done < st.st_size)
+			ret = _dsa_file_read(fd, ctx);
+	}
+	else
+		ret = _dsa_file_read(fd, ctx);
+
+	close(fd);
+
+	return ret;
+}
+#endif
+
+int dsa_verify_file(const char* path, dsa_pubkey* key, const char* sig)
+{
+	dsa_verify_ctx* ctx;
+	int ret = dsa_verify_init(&ctx, key, sig);
+
+	if (ret != DSA_VERIFICATION_OK)
+		return ret;
+
+	if ((ret = _dsa_file_hash(path, ctx)) != DSA_VERIFICATION_OK)
+	{
+		dsa_verify_abort(ctx);
+		return ret;
+	}
+
+	return dsa_verify_final(ctx);
+}
@@ -15,6 +15,18 @@
 
 #include "mp_math.h"
 
+#ifdef MP_HAVE_ADX
+#include <cpuid.h>
+#endif
+#ifdef MP_HAVE_IFMA
+#include <immintrin.h>
+#endif
+
+/* Karatsuba cutoffs, in digits. Tune them for the target machine with
+ * bench/tune.c, they can also be changed at runtime */
+int     KARATSUBA_MUL_CUTOFF = 64,      /* Min. number of digits before Karatsuba multiplication is used. */
+        KARATSUBA_SQR_CUTOFF = 128;     /* Min. number of digits before Karatsuba squaring is used. */
+
 int mp_init (mp_int * a)
 {
   int i;
@@ -178,6 +190,26 @@ int mp_init_size (mp_int * a, int size)
   return MP_OKAY;
 }
 
+int mp_shrink (mp_int * a)
+{
+  mp_digit *tmp;
+  int       used = 1;
+
+  /* trim the allocation down to the digits in use [but at least one] */
+  if (a->used > 0) {
+    used = a->used;
+  }
+
+  if (a->alloc != used) {
+    if ((tmp = OPT_CAST(mp_digit) XREALLOC (a->dp, sizeof (mp_digit) * used)) == NULL) {
+      return MP_MEM;
+    }
+    a->dp    = tmp;
+    a->alloc = used;
+  }
+  return MP_OKAY;
+}
+
 void mp_zero (mp_int * a)
 {
   int       n;
@@ -819,7 +851,10 @@ int mp_mul (mp_int * a, mp_int * b, mp_int * c)
   int     res, neg;
   neg = (a->sign == b->sign) ? MP_ZPOS : MP_NEG;
 
-  {
+  /* use Karatsuba? */
+  if (MIN (a->used, b->used) >= KARATSUBA_MUL_CUTOFF) {
+    res = mp_karatsuba_mul (a, b, c);
+  } else {
     /* can we use the fast multiplier?
      *
      * The fast multiplier can be used if the output will 
@@ -843,7 +878,21 @@ int mp_sqr (mp_int * a, mp_int * b)
 {
   int     res;
 
-  res = s_mp_sqr (a, b);
+  /* use Karatsuba? */
+  if (a->used >= KARATSUBA_SQR_CUTOFF) {
+    res = mp_karatsuba_sqr (a, b);
+  } else
+
+  /* can we use the fast comba squarer?
+   *
+   * Same limits as the fast multiplier, except that only half of
+   * the cross products of a column are summed before doubling it
+   */
+  if ((a->used * 2 + 1) < MP_WARRAY &&
+      a->used < (1 << (sizeof(mp_word) * CHAR_BIT - 2 * DIGIT_BIT - 1))) {
+    res = fast_s_mp_sqr (a, b);
+  } else
+    res = s_mp_sqr (a, b);
   b->sign = MP_ZPOS;
   return res;
 }
@@ -2160,8 +2209,11 @@ int mp_exptmod (mp_int * G, mp_int * X, mp_int * P, mp_int * Y)
      dr = mp_reduce_is_2k(P) << 1;
   }
     
-  /* if the modulus is odd or dr != 0 use the montgomery method */
-  if (mp_isodd (P) == 1 || dr !=  0) {
+  /* if the modulus is odd or dr != 0 use the montgomery method,
+   * fusing the multiplications and reductions when P is small enough */
+  if (dr == 0 && mp_isodd (P) == 1 && P->used < MP_FUSED_DIGITS) {
+    return mp_exptmod_fast (G, X, P, Y, s_mp_mont_mode (P));
+  } else if (mp_isodd (P) == 1 || dr !=  0) {
     return mp_exptmod_fast (G, X, P, Y, dr);
   } else {
     /* otherwise use the generic Barrett reduction technique */
@@ -2169,1187 +2221,3273 @@ int mp_exptmod (mp_int * G, mp_int * X, mp_int * P, mp_int * Y)
   }
 }
 
-int mp_count_bits (mp_int * a)
+/* the Montgomery flavour for an odd P below MP_FUSED_DIGITS digits: the
+ * IFMA engine from MP_R52_MIN_BITS on, full 64-bit limbs when the CPU has
+ * the ADX kernel for them, fused otherwise */
+int s_mp_mont_mode (mp_int * P)
 {
-  int     r;
-  mp_digit q;
+  int bits   = mp_count_bits (P),
+      kernel = mp_cpu_kernel ();
 
-  /* shortcut */
-  if (a->used == 0) {
-    return 0;
+  if ((kernel & MP_KERNEL_IFMA) != 0 && bits >= MP_R52_MIN_BITS &&
+      bits <= MP_R52_BIT * MP_R52_LIMBS) {
+     return MP_REDUCE_MONT_R52;
   }
+  if ((kernel & MP_KERNEL_ADX) != 0 && (((bits + MP_R64_BIT - 1) / MP_R64_BIT) & 3) == 0) {
+     return MP_REDUCE_MONT_R64;
+  }
+  return MP_REDUCE_MONT_FUSED;
+}
 
-  /* get number of digits and add that */
-  r = (a->used - 1) * DIGIT_BIT;
-  
-  /* take the last digit and count the bits in it */
-  q = a->dp[a->used - 1];
-  while (q > ((mp_digit) 0)) {
-    ++r;
-    q >>= ((mp_digit) 1);
+/* R = 2**(bits*c->N.used) mod P and R**2 mod P, both in limbs of the given size */
+static int s_mp_mod_ctx_setup_limbs (mp_mod_ctx * c, mp_int * P, int bits)
+{
+  int err;
+
+  if ((err = mp_2expt (&c->R, bits * c->N.used)) != MP_OKAY) {
+     return err;
   }
-  return r;
+  if ((err = mp_mod (&c->R, P, &c->R)) != MP_OKAY) {
+     return err;
+  }
+  if ((err = mp_sqr (&c->R, &c->RR)) != MP_OKAY) {
+     return err;
+  }
+  if ((err = mp_mod (&c->RR, P, &c->RR)) != MP_OKAY) {
+     return err;
+  }
+  if ((err = s_mp_pack_limbs (&c->R, bits, &c->R)) != MP_OKAY) {
+     return err;
+  }
+  return s_mp_pack_limbs (&c->RR, bits, &c->RR);
 }
 
-int mp_read_unsigned_bin (mp_int * a, const unsigned char *b, int c)
+int s_mp_mod_ctx_setup (mp_mod_ctx * c, mp_int * P, int mode)
 {
-  int     res;
+  int err;
 
-  /* make sure there are at least two digits */
-  if (a->alloc < 2) {
-     if ((res = mp_grow(a, 2)) != MP_OKAY) {
-        return res;
-     }
+  if ((err = mp_init_multi (&c->P, &c->mu, &c->R, &c->RR, &c->N, NULL)) != MP_OKAY) {
+    return err;
+  }
+  if ((err = mp_copy (P, &c->P)) != MP_OKAY) {
+    goto LBL_ERR;
   }
 
-  /* zero the int */
-  mp_zero (a);
+  c->mode   = mode;
+  c->rho    = 0;
+  c->kernel = mp_cpu_kernel ();
 
-  /* read the bytes in */
-  while (c-- > 0) {
-    if ((res = mp_mul_2d (a, 8, a)) != MP_OKAY) {
-      return res;
-    }
+  switch (mode) {
+  case MP_REDUCE_MONT_FUSED:
+     if (P->used >= MP_FUSED_DIGITS) {
+        err = MP_VAL;
+        goto LBL_ERR;
+     }
+     /* FALLTHROUGH */
+  case MP_REDUCE_MONT:
+     if ((err = mp_montgomery_setup (P, &c->rho)) != MP_OKAY) {
+        goto LBL_ERR;
+     }
 
-#ifndef MP_8BIT
-      a->dp[0] |= *b++;
-      a->used += 1;
-#else
-      a->dp[0] = (*b & MP_MASK);
-      a->dp[1] |= ((*b++ >> 7U) & 1);
-      a->used += 2;
-#endif
+     /* R mod P is the Montgomery form of 1, R**2 mod P converts into it */
+     if ((err = mp_montgomery_calc_normalization (&c->R, P)) != MP_OKAY) {
+        goto LBL_ERR;
+     }
+     if ((err = mp_sqr (&c->R, &c->RR)) != MP_OKAY) {
+        goto LBL_ERR;
+     }
+     if ((err = mp_mod (&c->RR, P, &c->RR)) != MP_OKAY) {
+        goto LBL_ERR;
+     }
+     return MP_OKAY;
+
+  case MP_REDUCE_MONT_R64:
+     if (sizeof (mp_digit) * CHAR_BIT < MP_R64_BIT || P->used >= MP_FUSED_DIGITS) {
+        err = MP_VAL;
+        goto LBL_ERR;
+     }
+     if ((err = s_mp_pack_limbs (P, MP_R64_BIT, &c->N)) != MP_OKAY) {
+        goto LBL_ERR;
+     }
+     if ((err = mp_montgomery_setup_r64 (&c->N, &c->rho)) != MP_OKAY) {
+        goto LBL_ERR;
+     }
+     if ((c->N.used & 3) != 0) {
+        /* the unrolled ADX rows take 4 limbs at a time */
+        c->kernel &= ~MP_KERNEL_ADX;
+     }
+
+     /* same as above with R = 2**(64*N.used), both kept in 64-bit limbs */
+     if ((err = s_mp_mod_ctx_setup_limbs (c, P, MP_R64_BIT)) != MP_OKAY) {
+        goto LBL_ERR;
+     }
+     return MP_OKAY;
+
+  case MP_REDUCE_MONT_R52:
+     /* there is no portable kernel for these limbs */
+     if ((c->kernel & MP_KERNEL_IFMA) == 0) {
+        err = MP_VAL;
+        goto LBL_ERR;
+     }
+     if ((err = s_mp_pack_limbs (P, MP_R52_BIT, &c->N)) != MP_OKAY) {
+        goto LBL_ERR;
+     }
+     if (c->N.used > MP_R52_LIMBS) {
+        err = MP_VAL;
+        goto LBL_ERR;
+     }
+
+     /* -1/P mod 2**64 works mod 2**52 too */
+     if ((err = mp_montgomery_setup_r64 (&c->N, &c->rho)) != MP_OKAY) {
+        goto LBL_ERR;
+     }
+     c->rho &= (((mp_digit) 1) << MP_R52_BIT) - 1;
+
+     if ((err = s_mp_mod_ctx_setup_limbs (c, P, MP_R52_BIT)) != MP_OKAY) {
+        goto LBL_ERR;
+     }
+     return MP_OKAY;
+
+  case MP_REDUCE_DR:
+     mp_dr_setup (P, &c->rho);
+     break;
+
+  case MP_REDUCE_2K:
+     if ((err = mp_reduce_2k_setup (P, &c->rho)) != MP_OKAY) {
+        goto LBL_ERR;
+     }
+     break;
+
+  case MP_REDUCE_BARRETT:
+     if ((err = mp_reduce_setup (&c->mu, P)) != MP_OKAY) {
+        goto LBL_ERR;
+     }
+     break;
+
+  case MP_REDUCE_2K_L:
+     if ((err = mp_reduce_2k_setup_l (P, &c->mu)) != MP_OKAY) {
+        goto LBL_ERR;
+     }
+     break;
+
+  default:
+     err = MP_VAL;
+     goto LBL_ERR;
   }
-  mp_clamp (a);
+
+  /* every other method works on plain residues */
+  mp_set (&c->R, 1);
+  mp_set (&c->RR, 1);
   return MP_OKAY;
-}
 
-const char *mp_s_rmap = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz+/";
+LBL_ERR:
+  mp_clear_multi (&c->P, &c->mu, &c->R, &c->RR, &c->N, NULL);
+  return err;
+}
 
-int mp_read_radix (mp_int * a, const char *str, int radix)
+int mp_mod_ctx_init (mp_mod_ctx * c, mp_int * P)
 {
-  int     y, res, neg;
-  char    ch;
+  int mode;
 
-  /* zero the digit bignum */
-  mp_zero(a);
-
-  /* make sure the radix is ok */
-  if (radix < 2 || radix > 64) {
-    return MP_VAL;
+  /* modulus P must be positive */
+  if (P->sign == MP_NEG || mp_iszero (P) == MP_YES) {
+     return MP_VAL;
   }
 
-  /* if the leading digit is a 
-   * minus set the sign to negative. 
-   */
-  if (*str == '-') {
-    ++str;
-    neg = MP_NEG;
+  /* same selection as mp_exptmod() */
+  if (mp_reduce_is_2k_l (P) == MP_YES) {
+     mode = MP_REDUCE_2K_L;
+  } else if (mp_dr_is_modulus (P) == 1) {
+     mode = MP_REDUCE_DR;
+  } else if (mp_reduce_is_2k (P) == MP_YES) {
+     mode = MP_REDUCE_2K;
+  } else if (mp_isodd (P) == MP_YES) {
+     mode = (P->used < MP_FUSED_DIGITS) ? s_mp_mont_mode (P) : MP_REDUCE_MONT;
   } else {
-    neg = MP_ZPOS;
+     mode = MP_REDUCE_BARRETT;
   }
 
-  /* set the integer to the default of zero */
-  mp_zero (a);
-  
-  /* process each digit of the string */
-  while (*str) {
-    /* if the radix < 36 the conversion is case insensitive
-     * this allows numbers like 1AB and 1ab to represent the same  value
-     * [e.g. in hex]
-     */
-    ch = (char) ((radix < 36) ? toupper (*str) : *str);
-    for (y = 0; y < 64; y++) {
-      if (ch == mp_s_rmap[y]) {
-         break;
-      }
-    }
+  return s_mp_mod_ctx_setup (c, P, mode);
+}
 
-    /* if the char was found in the map 
-     * and is less than the given radix add it
-     * to the number, otherwise exit the loop. 
-     */
-    if (y < radix) {
-      if ((res = mp_mul_d (a, (mp_digit) radix, a)) != MP_OKAY) {
-         return res;
-      }
-      if ((res = mp_add_d (a, (mp_digit) y, a)) != MP_OKAY) {
-         return res;
-      }
-    } else {
-      break;
+void mp_mod_ctx_clear (mp_mod_ctx * c)
+{
+  mp_clear_multi (&c->P, &c->mu, &c->R, &c->RR, &c->N, NULL);
+}
+
+int s_mp_ctx_reduce (mp_int * a, mp_mod_ctx * c)
+{
+  switch (c->mode) {
+  case MP_REDUCE_MONT:
+  case MP_REDUCE_MONT_FUSED:
+     /* pick the comba one if available (saves quite a few calls/ifs) */
+     if (((c->P.used * 2 + 1) < MP_WARRAY) &&
+          c->P.used < (1 << ((CHAR_BIT * sizeof (mp_word)) - (2 * DIGIT_BIT)))) {
+        return fast_mp_montgomery_reduce (a, &c->P, c->rho);
+     }
+     return mp_montgomery_reduce (a, &c->P, c->rho);
+  case MP_REDUCE_MONT_R64:
+     return mp_montgomery_reduce_r64 (a, &c->N, c->rho);
+  case MP_REDUCE_MONT_R52:
+     return mp_montgomery_reduce_r52_ifma (a, &c->N, c->rho);
+  case MP_REDUCE_DR:
+     return mp_dr_reduce (a, &c->P, c->rho);
+  case MP_REDUCE_2K:
+     return mp_reduce_2k (a, &c->P, c->rho);
+  case MP_REDUCE_BARRETT:
+     return mp_reduce (a, &c->P, &c->mu);
+  case MP_REDUCE_2K_L:
+     return mp_reduce_2k_l (a, &c->P, &c->mu);
+  }
+  return MP_VAL;
+}
+
+int s_mp_ctx_mul (mp_int * a, mp_int * b, mp_mod_ctx * c, mp_int * d)
+{
+  int err;
+
+  if (c->mode == MP_REDUCE_MONT_FUSED) {
+    return mp_montgomery_mul_fused (a, b, &c->P, c->rho, d);
+  }
+  if (c->mode == MP_REDUCE_MONT_R64) {
+    if ((c->kernel & MP_KERNEL_ADX) != 0) {
+      return mp_montgomery_mul_r64_adx (a, b, &c->N, c->rho, d);
     }
-    ++str;
+    return mp_montgomery_mul_r64 (a, b, &c->N, c->rho, d);
   }
-  
-  /* set the sign only if a != 0 */
-  if (mp_iszero(a) != 1) {
-     a->sign = neg;
+  if (c->mode == MP_REDUCE_MONT_R52) {
+    return mp_montgomery_mul_r52_ifma (a, b, &c->N, c->rho, d);
   }
-  return MP_OKAY;
+
+  if ((err = mp_mul (a, b, d)) != MP_OKAY) {
+    return err;
+  }
+  return s_mp_ctx_reduce (d, c);
 }
 
-int mp_toradix (mp_int * a, char *str, int radix)
+int s_mp_ctx_sqr (mp_int * a, mp_mod_ctx * c, mp_int * b)
 {
-  int     res, digs;
-  mp_int  t;
-  mp_digit d;
-  char   *_s = str;
+  int err;
 
-  /* check range of the radix */
-  if (radix < 2 || radix > 64) {
-    return MP_VAL;
+  if (c->mode == MP_REDUCE_MONT_FUSED) {
+    return mp_montgomery_sqr_fused (a, &c->P, c->rho, b);
+  }
+  if (c->mode == MP_REDUCE_MONT_R64) {
+    if ((c->kernel & MP_KERNEL_ADX) != 0) {
+      return mp_montgomery_sqr_r64_adx (a, &c->N, c->rho, b);
+    }
+    return mp_montgomery_sqr_r64 (a, &c->N, c->rho, b);
+  }
+  if (c->mode == MP_REDUCE_MONT_R52) {
+    return mp_montgomery_sqr_r52_ifma (a, &c->N, c->rho, b);
   }
 
-  /* quick out if its zero */
-  if (mp_iszero(a) == 1) {
-     *str++ = '0';
-     *str = '\0';
-     return MP_OKAY;
+  if ((err = mp_sqr (a, b)) != MP_OKAY) {
+    return err;
   }
+  return s_mp_ctx_reduce (b, c);
+}
 
-  if ((res = mp_init_copy (&t, a)) != MP_OKAY) {
-    return res;
+/* limb size of the representation of c, 0 for DIGIT_BIT digits */
+static int s_mp_ctx_limb_bits (mp_mod_ctx * c)
+{
+  switch (c->mode) {
+  case MP_REDUCE_MONT_R64:
+     return MP_R64_BIT;
+  case MP_REDUCE_MONT_R52:
+     return MP_R52_BIT;
   }
+  return 0;
+}
 
-  /* if it is negative output a - */
-  if (t.sign == MP_NEG) {
-    ++_s;
-    *str++ = '-';
-    t.sign = MP_ZPOS;
+int s_mp_ctx_enter (mp_int * a, mp_mod_ctx * c, mp_int * b)
+{
+  int err, bits;
+
+  /* reduce first if a is out of range */
+  if (a->sign == MP_NEG || mp_cmp_mag (a, &c->P) != MP_LT) {
+    if ((err = mp_mod (a, &c->P, b)) != MP_OKAY) {
+      return err;
+    }
+    a = b;
   }
 
-  digs = 0;
-  while (mp_iszero (&t) == 0) {
-    if ((res = mp_div_d (&t, (mp_digit) radix, &t, &d)) != MP_OKAY) {
-      mp_clear (&t);
-      return res;
+  if (!MP_REDUCE_IS_MONT (c->mode)) {
+    return mp_copy (a, b);
+  }
+  if ((bits = s_mp_ctx_limb_bits (c)) != 0) {
+    if ((err = s_mp_pack_limbs (a, bits, b)) != MP_OKAY) {
+      return err;
     }
-    *str++ = mp_s_rmap[d];
-    ++digs;
+    a = b;
   }
 
-  /* reverse the digits of the string.  In this case _s points
-   * to the first digit [exluding the sign] of the number]
-   */
-  bn_reverse ((unsigned char *)_s, digs);
+  /* a * R**2 / R = a * R (mod P) */
+  return s_mp_ctx_mul (a, &c->RR, c, b);
+}
 
-  /* append a NULL so the string is properly terminated */
-  *str = '\0';
+int s_mp_ctx_leave (mp_int * a, mp_mod_ctx * c, mp_int * b)
+{
+  int err, bits;
 
-  mp_clear (&t);
+  if ((err = mp_copy (a, b)) != MP_OKAY) {
+    return err;
+  }
+  if (!MP_REDUCE_IS_MONT (c->mode)) {
+    return MP_OKAY;
+  }
+
+  /* a * R / R = a (mod P) */
+  if ((err = s_mp_ctx_reduce (b, c)) != MP_OKAY) {
+    return err;
+  }
+  if ((bits = s_mp_ctx_limb_bits (c)) != 0) {
+    return s_mp_unpack_limbs (b, bits, b);
+  }
   return MP_OKAY;
 }
 
-int s_mp_add (mp_int * a, mp_int * b, mp_int * c)
+int mp_mulmod_ctx (mp_int * a, mp_int * b, mp_mod_ctx * c, mp_int * d)
 {
-  mp_int *x;
-  int     olduse, res, min, max;
+  mp_int  t;
+  int     err, bits;
 
-  /* find sizes, we let |a| <= |b| which means we have to sort
-   * them.  "x" will point to the input with the most digits
-   */
-  if (a->used > b->used) {
-    min = b->used;
-    max = a->used;
-    x = a;
-  } else {
-    min = a->used;
-    max = b->used;
-    x = b;
+  if ((err = mp_init (&t)) != MP_OKAY) {
+    return err;
   }
 
-  /* init result */
-  if (c->alloc < max + 1) {
-    if ((res = mp_grow (c, max + 1)) != MP_OKAY) {
-      return res;
+  /* one operand in Montgomery form cancels the R**-1 of the product */
+  if ((err = s_mp_ctx_enter (a, c, &t)) != MP_OKAY) {
+    goto LBL_T;
+  }
+  if (b->sign == MP_NEG || mp_cmp_mag (b, &c->P) != MP_LT) {
+    if ((err = mp_mod (b, &c->P, d)) != MP_OKAY) {
+      goto LBL_T;
     }
+    b = d;
   }
+  if ((bits = s_mp_ctx_limb_bits (c)) != 0) {
+    /* b in limbs too, the product then comes out as a plain residue in limbs */
+    if ((err = s_mp_pack_limbs (b, bits, d)) != MP_OKAY ||
+        (err = s_mp_ctx_mul (&t, d, c, d)) != MP_OKAY) {
+      goto LBL_T;
+    }
+    err = s_mp_unpack_limbs (d, bits, d);
+    goto LBL_T;
+  }
+  err = s_mp_ctx_mul (&t, b, c, d);
 
-  /* get old used digit count and set new one */
-  olduse = c->used;
-  c->used = max + 1;
-
-  {
-    register mp_digit u, *tmpa, *tmpb, *tmpc;
-    register int i;
+LBL_T:
+  mp_clear (&t);
+  return err;
+}
 
-    /* alias for digit pointers */
+int mp_exptmod_ctx (mp_int * G, mp_int * X, mp_mod_ctx * c, mp_int * Y)
+{
+  mp_int  t;
+  int     err;
 
-    /* first input */
-    tmpa = a->dp;
+  /* if exponent X is negative we have to recurse */
+  if (X->sign == MP_NEG) {
+     mp_int tmpG, tmpX;
+
+     /* compute (1/G)**|X| instead of G**X [X < 0] */
+     if ((err = mp_init_multi (&tmpG, &tmpX, NULL)) != MP_OKAY) {
+        return err;
+     }
+     if ((err = mp_invmod (G, &c->P, &tmpG)) == MP_OKAY &&
+         (err = mp_abs (X, &tmpX)) == MP_OKAY) {
+        err = mp_exptmod_ctx (&tmpG, &tmpX, c, Y);
+     }
+     mp_clear_multi (&tmpG, &tmpX, NULL);
+     return err;
+  }
+
+  if ((err = mp_init (&t)) != MP_OKAY) {
+    return err;
+  }
+  if ((err = s_mp_ctx_enter (G, c, &t)) == MP_OKAY &&
+      (err = s_mp_ctx_exptmod (&t, X, c, &t)) == MP_OKAY) {
+    err = s_mp_ctx_leave (&t, c, Y);
+  }
+  mp_clear (&t);
+  return err;
+}
+
+#define TAB_SIZE 256
+int s_mp_ctx_exptmod (mp_int * G, mp_int * X, mp_mod_ctx * c, mp_int * Y)
+{
+  mp_int  M[TAB_SIZE], res;
+  mp_digit buf;
+  int     err, bitbuf, bitcpy, bitcnt, mode, digidx, x, y, winsize;
+
+  if (X->sign == MP_NEG) {
+    return MP_VAL;
+  }
+
+  /* find window size */
+  x = mp_count_bits (X);
+  if (x <= 7) {
+    winsize = 2;
+  } else if (x <= 36) {
+    winsize = 3;
+  } else if (x <= 140) {
+    winsize = 4;
+  } else if (x <= 450) {
+    winsize = 5;
+  } else if (x <= 1303) {
+    winsize = 6;
+  } else if (x <= 3529) {
+    winsize = 7;
+  } else {
+    winsize = 8;
+  }
+
+  /* init M array */
+  /* init first cell */
+  if ((err = mp_init(&M[1])) != MP_OKAY) {
+     return err;
+  }
+
+  /* now init the second half of the array */
+  for (x = 1<<(winsize-1); x < (1 << winsize); x++) {
+    if ((err = mp_init(&M[x])) != MP_OKAY) {
+      for (y = 1<<(winsize-1); y < x; y++) {
+        mp_clear (&M[y]);
+      }
+      mp_clear(&M[1]);
+      return err;
+    }
+  }
+
+  /* setup result, the context's representation of 1 */
+  if ((err = mp_init_copy (&res, &c->R)) != MP_OKAY) {
+    goto LBL_M;
+  }
+
+  /* create M table
+   *
+   * The M table contains powers of the base, 
+   * e.g. M[x] = G**x mod P
+   *
+   * The first half of the table is not computed though accept for M[0] and M[1]
+   */
+  if ((err = mp_copy (G, &M[1])) != MP_OKAY) {
+    goto LBL_RES;
+  }
+
+  /* compute the value at M[1<<(winsize-1)] by squaring M[1] (winsize-1) times */
+  if ((err = mp_copy (&M[1], &M[1 << (winsize - 1)])) != MP_OKAY) {
+    goto LBL_RES;
+  }
+
+  for (x = 0; x < (winsize - 1); x++) {
+    if ((err = s_mp_ctx_sqr (&M[1 << (winsize - 1)], c, &M[1 << (winsize - 1)])) != MP_OKAY) {
+      goto LBL_RES;
+    }
+  }
+
+  /* create upper table */
+  for (x = (1 << (winsize - 1)) + 1; x < (1 << winsize); x++) {
+    if ((err = s_mp_ctx_mul (&M[x - 1], &M[1], c, &M[x])) != MP_OKAY) {
+      goto LBL_RES;
+    }
+  }
+
+  /* set initial mode and bit cnt */
+  mode   = 0;
+  bitcnt = 1;
+  buf    = 0;
+  digidx = X->used - 1;
+  bitcpy = 0;
+  bitbuf = 0;
+
+  for (;;) {
+    /* grab next digit as required */
+    if (--bitcnt == 0) {
+      /* if digidx == -1 we are out of digits so break */
+      if (digidx == -1) {
+        break;
+      }
+      /* read next digit and reset bitcnt */
+      buf    = X->dp[digidx--];
+      bitcnt = (int)DIGIT_BIT;
+    }
+
+    /* grab the next msb from the exponent */
+    y     = (mp_digit)(buf >> (DIGIT_BIT - 1)) & 1;
+    buf <<= (mp_digit)1;
+
+    /* if the bit is zero and mode == 0 then we ignore it
+     * These represent the leading zero bits before the first 1 bit
+     * in the exponent.  Technically this opt is not required but it
+     * does lower the # of trivial squaring/reductions used
+     */
+    if (mode == 0 && y == 0) {
+      continue;
+    }
+
+    /* if the bit is zero and mode == 1 then we square */
+    if (mode == 1 && y == 0) {
+      if ((err = s_mp_ctx_sqr (&res, c, &res)) != MP_OKAY) {
+        goto LBL_RES;
+      }
+      continue;
+    }
+
+    /* else we add it to the window */
+    bitbuf |= (y << (winsize - ++bitcpy));
+    mode    = 2;
+
+    if (bitcpy == winsize) {
+      /* ok window is filled so square as required and multiply  */
+      /* square first */
+      for (x = 0; x < winsize; x++) {
+        if ((err = s_mp_ctx_sqr (&res, c, &res)) != MP_OKAY) {
+          goto LBL_RES;
+        }
+      }
+
+      /* then multiply */
+      if ((err = s_mp_ctx_mul (&res, &M[bitbuf], c, &res)) != MP_OKAY) {
+        goto LBL_RES;
+      }
+
+      /* empty window and reset */
+      bitcpy = 0;
+      bitbuf = 0;
+      mode   = 1;
+    }
+  }
+
+  /* if bits remain then square/multiply */
+  if (mode == 2 && bitcpy > 0) {
+    /* square then multiply if the bit is set */
+    for (x = 0; x < bitcpy; x++) {
+      if ((err = s_mp_ctx_sqr (&res, c, &res)) != MP_OKAY) {
+        goto LBL_RES;
+      }
+
+      /* get next bit of the window */
+      bitbuf <<= 1;
+      if ((bitbuf & (1 << winsize)) != 0) {
+        /* then multiply */
+        if ((err = s_mp_ctx_mul (&res, &M[1], c, &res)) != MP_OKAY) {
+          goto LBL_RES;
+        }
+      }
+    }
+  }
+
+  mp_exch (&res, Y);
+  err = MP_OKAY;
+LBL_RES:mp_clear (&res);
+LBL_M:
+  mp_clear(&M[1]);
+  for (x = 1<<(winsize-1); x < (1 << winsize); x++) {
+    mp_clear (&M[x]);
+  }
+  return err;
+}
+
+/* returns bit n of |a| */
+static int s_mp_get_bit (mp_int * a, int n)
+{
+  int d = n / DIGIT_BIT;
+
+  if (d >= a->used) {
+    return 0;
+  }
+  return (int)((a->dp[d] >> (n % DIGIT_BIT)) & 1);
+}
+
+int mp_comb_init (mp_comb * T, mp_int * G, int bits, int teeth, mp_mod_ctx * c)
+{
+  mp_int  B;
+  int     err, x, y, top;
+
+  if (teeth < 1 || teeth > MP_COMB_MAX_TEETH || bits < 1) {
+    return MP_VAL;
+  }
+
+  T->teeth   = teeth;
+  T->spacing = (bits + teeth - 1) / teeth;
+  T->T       = OPT_CAST(mp_int) XMALLOC (sizeof (mp_int) << teeth);
+  if (T->T == NULL) {
+    return MP_MEM;
+  }
+
+  for (x = 0; x < (1 << teeth); x++) {
+    if ((err = mp_init (&T->T[x])) != MP_OKAY) {
+      while (x-- > 0) {
+        mp_clear (&T->T[x]);
+      }
+      XFREE (T->T);
+      T->T = NULL;
+      return err;
+    }
+  }
+
+  if ((err = mp_init (&B)) != MP_OKAY) {
+    goto LBL_ERR;
+  }
+
+  /* T[0] = 1, B = G**(2**(j*spacing)) for the j'th tooth */
+  if ((err = mp_copy (&c->R, &T->T[0])) != MP_OKAY) {
+    goto LBL_B;
+  }
+  if ((err = s_mp_ctx_enter (G, c, &B)) != MP_OKAY) {
+    goto LBL_B;
+  }
+
+  for (y = 0; y < teeth; y++) {
+    if (y > 0) {
+      for (x = 0; x < T->spacing; x++) {
+        if ((err = s_mp_ctx_sqr (&B, c, &B)) != MP_OKAY) {
+          goto LBL_B;
+        }
+      }
+    }
+
+    /* T[2**y + i] = B * T[i] for every i < 2**y */
+    top = 1 << y;
+    if ((err = mp_copy (&B, &T->T[top])) != MP_OKAY) {
+      goto LBL_B;
+    }
+    for (x = 1; x < top; x++) {
+      if ((err = s_mp_ctx_mul (&B, &T->T[x], c, &T->T[top + x])) != MP_OKAY) {
+        goto LBL_B;
+      }
+    }
+  }
+
+  /* the table is read-only from now on, drop the slack of every entry */
+  for (x = 0; x < (1 << teeth); x++) {
+    if ((err = mp_shrink (&T->T[x])) != MP_OKAY) {
+      goto LBL_B;
+    }
+  }
+
+  mp_clear (&B);
+  return MP_OKAY;
+
+LBL_B:
+  mp_clear (&B);
+LBL_ERR:
+  mp_comb_clear (T);
+  return err;
+}
+
+void mp_comb_clear (mp_comb * T)
+{
+  int x;
+
+  if (T->T == NULL) {
+    return;
+  }
+  for (x = 0; x < (1 << T->teeth); x++) {
+    mp_clear (&T->T[x]);
+  }
+  XFREE (T->T);
+  T->T = NULL;
+}
+
+size_t mp_comb_size (int teeth, mp_mod_ctx * c)
+{
+  return ((size_t)1 << teeth) * (sizeof (mp_int) + sizeof (mp_digit) * (size_t)c->P.used);
+}
+
+int mp_exptmod_comb (mp_comb * T, mp_int * X, mp_mod_ctx * c, mp_int * Y)
+{
+  mp_int  res;
+  int     err, x, y, idx, started;
+
+  /* exponents the table doesn't cover go through the generic code */
+  if (X->sign == MP_NEG || mp_count_bits (X) > T->teeth * T->spacing) {
+    if ((err = mp_init (&res)) != MP_OKAY) {
+      return err;
+    }
+    if ((err = s_mp_ctx_leave (&T->T[1], c, &res)) == MP_OKAY) {
+      err = mp_exptmod_ctx (&res, X, c, Y);
+    }
+    mp_clear (&res);
+    return err;
+  }
+
+  if ((err = mp_init_copy (&res, &c->R)) != MP_OKAY) {
+    return err;
+  }
+
+  /* walk the columns of the comb from the most significant one, each
+   * column picks one bit from every tooth
+   */
+  started = 0;
+  for (x = T->spacing - 1; x >= 0; x--) {
+    if (started) {
+      if ((err = s_mp_ctx_sqr (&res, c, &res)) != MP_OKAY) {
+        goto LBL_RES;
+      }
+    }
+
+    idx = 0;
+    for (y = 0; y < T->teeth; y++) {
+      idx |= s_mp_get_bit (X, y * T->spacing + x) << y;
+    }
+
+    if (idx != 0) {
+      if ((err = s_mp_ctx_mul (&res, &T->T[idx], c, &res)) != MP_OKAY) {
+        goto LBL_RES;
+      }
+      started = 1;
+    }
+  }
+
+  err = s_mp_ctx_leave (&res, c, Y);
+LBL_RES:
+  mp_clear (&res);
+  return err;
+}
+
+/* one base of a simultaneous exponentiation, either a comb table or a
+ * sliding window over the odd powers of the base
+ */
+typedef struct {
+  mp_comb *T;        /* fixed-base table, NULL for a sliding window */
+  mp_int  *X;        /* exponent */
+  mp_int  *M;        /* G, G**3, G**5, ..., G**(2**winsize - 1) */
+  int     *win;      /* win[i] != 0: multiply by G**win[i] at bit i */
+  int      winsize;
+  int      len;      /* number of squarings this base needs */
+} s_mp_exp_term;
+
+static int s_mp_exp_term_init (s_mp_exp_term * t, mp_int * G, mp_comb * T, mp_int * X, mp_mod_ctx * c)
+{
+  mp_int  G2;
+  int     err, x, y, lo, val, bits;
+
+  t->X   = X;
+  t->M   = NULL;
+  t->win = NULL;
+
+  bits = mp_count_bits (X);
+  if (T != NULL && bits <= T->teeth * T->spacing) {
+    t->T   = T;
+    t->len = T->spacing;
+    return MP_OKAY;
+  }
+
+  t->T   = NULL;
+  t->len = bits;
+
+  /* find window size, smaller than for a lone exponentiation since
+   * the squarings are shared and only the table is paid per base
+   */
+  if (bits <= 16) {
+    t->winsize = 2;
+  } else if (bits <= 80) {
+    t->winsize = 3;
+  } else if (bits <= 240) {
+    t->winsize = 4;
+  } else if (bits <= 672) {
+    t->winsize = 5;
+  } else {
+    t->winsize = 6;
+  }
+
+  /* split the exponent into windows that start and end with a one bit */
+  t->win = OPT_CAST(int) XCALLOC ((size_t)MAX(bits, 1), sizeof (int));
+  if (t->win == NULL) {
+    return MP_MEM;
+  }
+
+  for (x = bits - 1; x >= 0; ) {
+    if (s_mp_get_bit (X, x) == 0) {
+      x--;
+      continue;
+    }
+
+    lo = MAX(x - t->winsize + 1, 0);
+    while (s_mp_get_bit (X, lo) == 0) {
+      lo++;
+    }
+
+    for (val = 0, y = x; y >= lo; y--) {
+      val = (val << 1) | s_mp_get_bit (X, y);
+    }
+    t->win[lo] = val;
+    x = lo - 1;
+  }
+
+  /* M[i] = G**(2i + 1) */
+  t->M = OPT_CAST(mp_int) XMALLOC (sizeof (mp_int) << (t->winsize - 1));
+  if (t->M == NULL) {
+    XFREE (t->win);
+    t->win = NULL;
+    return MP_MEM;
+  }
+
+  for (x = 0; x < (1 << (t->winsize - 1)); x++) {
+    if ((err = mp_init (&t->M[x])) != MP_OKAY) {
+      while (x-- > 0) {
+        mp_clear (&t->M[x]);
+      }
+      XFREE (t->M);
+      XFREE (t->win);
+      t->M   = NULL;
+      t->win = NULL;
+      return err;
+    }
+  }
+
+  if ((err = mp_init (&G2)) != MP_OKAY) {
+    goto LBL_ERR;
+  }
+  if ((err = mp_copy (G, &t->M[0])) != MP_OKAY) {
+    goto LBL_G2;
+  }
+  if ((err = s_mp_ctx_sqr (&t->M[0], c, &G2)) != MP_OKAY) {
+    goto LBL_G2;
+  }
+  for (x = 1; x < (1 << (t->winsize - 1)); x++) {
+    if ((err = s_mp_ctx_mul (&t->M[x - 1], &G2, c, &t->M[x])) != MP_OKAY) {
+      goto LBL_G2;
+    }
+  }
+
+  mp_clear (&G2);
+  return MP_OKAY;
+
+LBL_G2:
+  mp_clear (&G2);
+LBL_ERR:
+  for (x = 0; x < (1 << (t->winsize - 1)); x++) {
+    mp_clear (&t->M[x]);
+  }
+  XFREE (t->M);
+  XFREE (t->win);
+  t->M   = NULL;
+  t->win = NULL;
+  return err;
+}
+
+static void s_mp_exp_term_clear (s_mp_exp_term * t)
+{
+  int x;
+
+  if (t->M != NULL) {
+    for (x = 0; x < (1 << (t->winsize - 1)); x++) {
+      mp_clear (&t->M[x]);
+    }
+    XFREE (t->M);
+  }
+  if (t->win != NULL) {
+    XFREE (t->win);
+  }
+}
+
+/* multiplier of the given base for bit x of the squaring chain, NULL if none */
+static mp_int *s_mp_exp_term_step (s_mp_exp_term * t, int x)
+{
+  int y, idx;
+
+  if (x >= t->len) {
+    return NULL;
+  }
+
+  if (t->T == NULL) {
+    return (t->win[x] != 0) ? &t->M[t->win[x] >> 1] : NULL;
+  }
+
+  for (idx = 0, y = 0; y < t->T->teeth; y++) {
+    idx |= s_mp_get_bit (t->X, y * t->T->spacing + x) << y;
+  }
+  return (idx != 0) ? &t->T->T[idx] : NULL;
+}
+
+int mp_exptmod2_ctx (mp_int * G1, mp_comb * T1, mp_int * X1, mp_int * G2, mp_comb * T2, mp_int * X2, mp_mod_ctx * c, mp_int * Y)
+{
+  mp_int  t1, t2;
+  int     err;
+
+  /* negative exponents use the inverse of their base [and no comb] */
+  if (X1->sign == MP_NEG || X2->sign == MP_NEG) {
+    mp_int tmpG, tmpX;
+    int    first = (X1->sign == MP_NEG);
+
+    if ((err = mp_init_multi (&tmpG, &tmpX, NULL)) != MP_OKAY) {
+      return err;
+    }
+    if ((err = mp_invmod (first ? G1 : G2, &c->P, &tmpG)) == MP_OKAY &&
+        (err = mp_abs (first ? X1 : X2, &tmpX)) == MP_OKAY) {
+      if (first) {
+        err = mp_exptmod2_ctx (&tmpG, NULL, &tmpX, G2, T2, X2, c, Y);
+      } else {
+        err = mp_exptmod2_ctx (G1, T1, X1, &tmpG, NULL, &tmpX, c, Y);
+      }
+    }
+    mp_clear_multi (&tmpG, &tmpX, NULL);
+    return err;
+  }
+
+  if ((err = mp_init_multi (&t1, &t2, NULL)) != MP_OKAY) {
+    return err;
+  }
+  if ((err = s_mp_ctx_enter (G1, c, &t1)) == MP_OKAY &&
+      (err = s_mp_ctx_enter (G2, c, &t2)) == MP_OKAY &&
+      (err = s_mp_ctx_exptmod2 (&t1, T1, X1, &t2, T2, X2, c, &t1)) == MP_OKAY) {
+    err = s_mp_ctx_leave (&t1, c, Y);
+  }
+  mp_clear_multi (&t1, &t2, NULL);
+  return err;
+}
+
+int s_mp_ctx_exptmod2 (mp_int * G1, mp_comb * T1, mp_int * X1, mp_int * G2, mp_comb * T2, mp_int * X2, mp_mod_ctx * c, mp_int * Y)
+{
+  s_mp_exp_term t[2];
+  mp_int  res, *m;
+  int     err, x, y, started;
+
+  if (X1->sign == MP_NEG || X2->sign == MP_NEG) {
+    return MP_VAL;
+  }
+
+  if ((err = s_mp_exp_term_init (&t[0], G1, T1, X1, c)) != MP_OKAY) {
+    return err;
+  }
+  if ((err = s_mp_exp_term_init (&t[1], G2, T2, X2, c)) != MP_OKAY) {
+    goto LBL_T0;
+  }
+  if ((err = mp_init_copy (&res, &c->R)) != MP_OKAY) {
+    goto LBL_T1;
+  }
+
+  /* one shared chain of squarings, each base multiplies its windows
+   * [or comb columns] in as the chain reaches their lowest bit
+   */
+  started = 0;
+  for (x = MAX(t[0].len, t[1].len) - 1; x >= 0; x--) {
+    if (started) {
+      if ((err = s_mp_ctx_sqr (&res, c, &res)) != MP_OKAY) {
+        goto LBL_RES;
+      }
+    }
+
+    for (y = 0; y < 2; y++) {
+      if ((m = s_mp_exp_term_step (&t[y], x)) == NULL) {
+        continue;
+      }
+
+      if (started) {
+        err = s_mp_ctx_mul (&res, m, c, &res);
+      } else {
+        err = mp_copy (m, &res);
+      }
+      if (err != MP_OKAY) {
+        goto LBL_RES;
+      }
+      started = 1;
+    }
+  }
+
+  mp_exch (&res, Y);
+  err = MP_OKAY;
+LBL_RES:
+  mp_clear (&res);
+LBL_T1:
+  s_mp_exp_term_clear (&t[1]);
+LBL_T0:
+  s_mp_exp_term_clear (&t[0]);
+  return err;
+}
+
+int mp_exptmod2 (mp_int * G1, mp_int * X1, mp_int * G2, mp_int * X2, mp_int * P, mp_int * Y)
+{
+  mp_mod_ctx c;
+  int        err;
+
+  if ((err = mp_mod_ctx_init (&c, P)) != MP_OKAY) {
+    return err;
+  }
+
+  err = mp_exptmod2_ctx (G1, NULL, X1, G2, NULL, X2, &c, Y);
+  mp_mod_ctx_clear (&c);
+  return err;
+}
+
+int mp_count_bits (mp_int * a)
+{
+  int     r;
+  mp_digit q;
+
+  /* shortcut */
+  if (a->used == 0) {
+    return 0;
+  }
+
+  /* get number of digits and add that */
+  r = (a->used - 1) * DIGIT_BIT;
+  
+  /* take the last digit and count the bits in it */
+  q = a->dp[a->used - 1];
+  while (q > ((mp_digit) 0)) {
+    ++r;
+    q >>= ((mp_digit) 1);
+  }
+  return r;
+}
+
+int mp_read_unsigned_bin (mp_int * a, const unsigned char *b, int c)
+{
+  int       res, ix, bits, digs;
+  mp_digit *tmp;
+
+  /* skip the leading zero bytes, they only cost digits */
+  while (c > 0 && *b == 0) {
+    ++b;
+    --c;
+  }
+
+  /* one allocation covers every digit the bytes can reach, at least two */
+  digs = MAX((c * 8) / DIGIT_BIT + 1, 2);
+  if ((res = mp_grow (a, digs)) != MP_OKAY) {
+    return res;
+  }
+
+  /* zero the int */
+  mp_zero (a);
+
+  /* pack the bytes straight into the digits, from the least significant
+   * one (the last) up, instead of shifting the whole number for each */
+  tmp  = a->dp;
+  bits = 0;
+  for (ix = c - 1; ix >= 0; ix--) {
+    *tmp |= (((mp_digit) b[ix]) << bits) & MP_MASK;
+    bits += 8;
+
+    /* the bits of the byte that didn't fit start the next digit(s) */
+    while (bits >= DIGIT_BIT) {
+      bits -= DIGIT_BIT;
+      *++tmp = (mp_digit) ((b[ix] >> (8 - bits)) & MP_MASK);
+    }
+  }
+
+  a->used = digs;
+  mp_clamp (a);
+  return MP_OKAY;
+}
+
+/* get the size for an unsigned equivalent */
+int mp_unsigned_bin_size (mp_int * a)
+{
+  int     size = mp_count_bits (a);
+  return (size / 8 + ((size & 7) != 0 ? 1 : 0));
+}
+
+/* store in unsigned [big endian] format, the mp_unsigned_bin_size(a) bytes
+ * of b are filled from the digits in a single pass */
+int mp_to_unsigned_bin (mp_int * a, unsigned char *b)
+{
+  int       ix, len, pos, off;
+  mp_digit  d;
+
+  len = mp_unsigned_bin_size (a);
+  for (ix = 0; ix < len; ix++) {
+    /* byte ix, counting from the least significant one */
+    pos = (ix * 8) / DIGIT_BIT;
+    off = (ix * 8) % DIGIT_BIT;
+    d   = a->dp[pos] >> off;
+
+    /* a byte spans at most two digits */
+    if (off + 8 > DIGIT_BIT && pos + 1 < a->used) {
+      d |= a->dp[pos + 1] << (DIGIT_BIT - off);
+    }
+    b[len - 1 - ix] = (unsigned char) (d & 255);
+  }
+  return MP_OKAY;
+}
+
+const char *mp_s_rmap = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz+/";
+
+int mp_read_radix (mp_int * a, const char *str, int radix)
+{
+  int     y, res, neg;
+  char    ch;
+
+  /* zero the digit bignum */
+  mp_zero(a);
+
+  /* make sure the radix is ok */
+  if (radix < 2 || radix > 64) {
+    return MP_VAL;
+  }
+
+  /* if the leading digit is a 
+   * minus set the sign to negative. 
+   */
+  if (*str == '-') {
+    ++str;
+    neg = MP_NEG;
+  } else {
+    neg = MP_ZPOS;
+  }
+
+  /* set the integer to the default of zero */
+  mp_zero (a);
+  
+  /* process each digit of the string */
+  while (*str) {
+    /* if the radix < 36 the conversion is case insensitive
+     * this allows numbers like 1AB and 1ab to represent the same  value
+     * [e.g. in hex]
+     */
+    ch = (char) ((radix < 36) ? toupper (*str) : *str);
+    for (y = 0; y < 64; y++) {
+      if (ch == mp_s_rmap[y]) {
+         break;
+      }
+    }
+
+    /* if the char was found in the map 
+     * and is less than the given radix add it
+     * to the number, otherwise exit the loop. 
+     */
+    if (y < radix) {
+      if ((res = mp_mul_d (a, (mp_digit) radix, a)) != MP_OKAY) {
+         return res;
+      }
+      if ((res = mp_add_d (a, (mp_digit) y, a)) != MP_OKAY) {
+         return res;
+      }
+    } else {
+      break;
+    }
+    ++str;
+  }
+  
+  /* set the sign only if a != 0 */
+  if (mp_iszero(a) != 1) {
+     a->sign = neg;
+  }
+  return MP_OKAY;
+}
+
+int mp_toradix (mp_int * a, char *str, int radix)
+{
+  int     res, digs;
+  mp_int  t;
+  mp_digit d;
+  char   *_s = str;
+
+  /* check range of the radix */
+  if (radix < 2 || radix > 64) {
+    return MP_VAL;
+  }
+
+  /* quick out if its zero */
+  if (mp_iszero(a) == 1) {
+     *str++ = '0';
+     *str = '\0';
+     return MP_OKAY;
+  }
+
+  if ((res = mp_init_copy (&t, a)) != MP_OKAY) {
+    return res;
+  }
+
+  /* if it is negative output a - */
+  if (t.sign == MP_NEG) {
+    ++_s;
+    *str++ = '-';
+    t.sign = MP_ZPOS;
+  }
+
+  digs = 0;
+  while (mp_iszero (&t) == 0) {
+    if ((res = mp_div_d (&t, (mp_digit) radix, &t, &d)) != MP_OKAY) {
+      mp_clear (&t);
+      return res;
+    }
+    *str++ = mp_s_rmap[d];
+    ++digs;
+  }
+
+  /* reverse the digits of the string.  In this case _s points
+   * to the first digit [exluding the sign] of the number]
+   */
+  bn_reverse ((unsigned char *)_s, digs);
+
+  /* append a NULL so the string is properly terminated */
+  *str = '\0';
+
+  mp_clear (&t);
+  return MP_OKAY;
+}
+
+int s_mp_add (mp_int * a, mp_int * b, mp_int * c)
+{
+  mp_int *x;
+  int     olduse, res, min, max;
+
+  /* find sizes, we let |a| <= |b| which means we have to sort
+   * them.  "x" will point to the input with the most digits
+   */
+  if (a->used > b->used) {
+    min = b->used;
+    max = a->used;
+    x = a;
+  } else {
+    min = a->used;
+    max = b->used;
+    x = b;
+  }
+
+  /* init result */
+  if (c->alloc < max + 1) {
+    if ((res = mp_grow (c, max + 1)) != MP_OKAY) {
+      return res;
+    }
+  }
+
+  /* get old used digit count and set new one */
+  olduse = c->used;
+  c->used = max + 1;
+
+  {
+    register mp_digit u, *tmpa, *tmpb, *tmpc;
+    register int i;
+
+    /* alias for digit pointers */
+
+    /* first input */
+    tmpa = a->dp;
 
     /* second input */
     tmpb = b->dp;
 
-    /* destination */
-    tmpc = c->dp;
+    /* destination */
+    tmpc = c->dp;
+
+    /* zero the carry */
+    u = 0;
+    for (i = 0; i < min; i++) {
+      /* Compute the sum at one digit, T[i] = A[i] + B[i] + U */
+      *tmpc = *tmpa++ + *tmpb++ + u;
+
+      /* U = carry bit of T[i] */
+      u = *tmpc >> ((mp_digit)DIGIT_BIT);
+
+      /* take away carry bit from T[i] */
+      *tmpc++ &= MP_MASK;
+    }
+
+    /* now copy higher words if any, that is in A+B 
+     * if A or B has more digits add those in 
+     */
+    if (min != max) {
+      for (; i < max; i++) {
+        /* T[i] = X[i] + U */
+        *tmpc = x->dp[i] + u;
+
+        /* U = carry bit of T[i] */
+        u = *tmpc >> ((mp_digit)DIGIT_BIT);
+
+        /* take away carry bit from T[i] */
+        *tmpc++ &= MP_MASK;
+      }
+    }
+
+    /* add carry */
+    *tmpc++ = u;
+
+    /* clear digits above oldused */
+    for (i = c->used; i < olduse; i++) {
+      *tmpc++ = 0;
+    }
+  }
+
+  mp_clamp (c);
+  return MP_OKAY;
+}
+
+int s_mp_sub (mp_int * a, mp_int * b, mp_int * c)
+{
+  int     olduse, res, min, max;
+
+  /* find sizes */
+  min = b->used;
+  max = a->used;
+
+  /* init result */
+  if (c->alloc < max) {
+    if ((res = mp_grow (c, max)) != MP_OKAY) {
+      return res;
+    }
+  }
+  olduse = c->used;
+  c->used = max;
+
+  {
+    register mp_digit u, *tmpa, *tmpb, *tmpc;
+    register int i;
+
+    /* alias for digit pointers */
+    tmpa = a->dp;
+    tmpb = b->dp;
+    tmpc = c->dp;
+
+    /* set carry to zero */
+    u = 0;
+    for (i = 0; i < min; i++) {
+      /* T[i] = A[i] - B[i] - U */
+      *tmpc = *tmpa++ - *tmpb++ - u;
+
+      /* U = carry bit of T[i]
+       * Note this saves performing an AND operation since
+       * if a carry does occur it will propagate all the way to the
+       * MSB.  As a result a single shift is enough to get the carry
+       */
+      u = *tmpc >> ((mp_digit)(CHAR_BIT * sizeof (mp_digit) - 1));
+
+      /* Clear carry from T[i] */
+      *tmpc++ &= MP_MASK;
+    }
+
+    /* now copy higher words if any, e.g. if A has more digits than B  */
+    for (; i < max; i++) {
+      /* T[i] = A[i] - U */
+      *tmpc = *tmpa++ - u;
+
+      /* U = carry bit of T[i] */
+      u = *tmpc >> ((mp_digit)(CHAR_BIT * sizeof (mp_digit) - 1));
+
+      /* Clear carry from T[i] */
+      *tmpc++ &= MP_MASK;
+    }
+
+    /* clear digits above used (since we may not have grown result above) */
+    for (i = c->used; i < olduse; i++) {
+      *tmpc++ = 0;
+    }
+  }
+
+  mp_clamp (c);
+  return MP_OKAY;
+}
+
+int fast_s_mp_mul_digs (mp_int * a, mp_int * b, mp_int * c, int digs)
+{
+  int     olduse, res, pa, ix, iz;
+  mp_digit W[MP_WARRAY];
+  register mp_word  _W;
+
+  /* grow the destination as required */
+  if (c->alloc < digs) {
+    if ((res = mp_grow (c, digs)) != MP_OKAY) {
+      return res;
+    }
+  }
+
+  /* number of output digits to produce */
+  pa = MIN(digs, a->used + b->used);
+
+  /* clear the carry */
+  _W = 0;
+  for (ix = 0; ix < pa; ix++) { 
+      int      tx, ty;
+      int      iy;
+      mp_digit *tmpx, *tmpy;
+
+      /* get offsets into the two bignums */
+      ty = MIN(b->used-1, ix);
+      tx = ix - ty;
+
+      /* setup temp aliases */
+      tmpx = a->dp + tx;
+      tmpy = b->dp + ty;
+
+      /* this is the number of times the loop will iterrate, essentially 
+         while (tx++ < a->used && ty-- >= 0) { ... }
+       */
+      iy = MIN(a->used-tx, ty+1);
+
+      /* execute loop */
+      for (iz = 0; iz < iy; ++iz) {
+         _W += ((mp_word)*tmpx++)*((mp_word)*tmpy--);
+
+      }
+
+      /* store term */
+      W[ix] = ((mp_digit)_W) & MP_MASK;
+
+      /* make next carry */
+      _W = _W >> ((mp_word)DIGIT_BIT);
+ }
+
+  /* setup dest */
+  olduse  = c->used;
+  c->used = pa;
+
+  {
+    register mp_digit *tmpc;
+    tmpc = c->dp;
+    for (ix = 0; ix < pa+1; ix++) {
+      /* now extract the previous digit [below the carry] */
+      *tmpc++ = W[ix];
+    }
+
+    /* clear unused digits [that existed in the old copy of c] */
+    for (; ix < olduse; ix++) {
+      *tmpc++ = 0;
+    }
+  }
+  mp_clamp (c);
+  return MP_OKAY;
+}
+
+int s_mp_mul_digs (mp_int * a, mp_int * b, mp_int * c, int digs)
+{
+  mp_int  t;
+  int     res, pa, pb, ix, iy;
+  mp_digit u;
+  mp_word r;
+  mp_digit tmpx, *tmpt, *tmpy;
+
+  /* can we use the fast multiplier? */
+  if (((digs) < MP_WARRAY) &&
+      MIN (a->used, b->used) < 
+          (1 << ((CHAR_BIT * sizeof (mp_word)) - (2 * DIGIT_BIT)))) {
+    return fast_s_mp_mul_digs (a, b, c, digs);
+  }
+
+  if ((res = mp_init_size (&t, digs)) != MP_OKAY) {
+    return res;
+  }
+  t.used = digs;
+
+  /* compute the digits of the product directly */
+  pa = a->used;
+  for (ix = 0; ix < pa; ix++) {
+    /* set the carry to zero */
+    u = 0;
+
+    /* limit ourselves to making digs digits of output */
+    pb = MIN (b->used, digs - ix);
+
+    /* setup some aliases */
+    /* copy of the digit from a used within the nested loop */
+    tmpx = a->dp[ix];
+    
+    /* an alias for the destination shifted ix places */
+    tmpt = t.dp + ix;
+    
+    /* an alias for the digits of b */
+    tmpy = b->dp;
+
+    /* compute the columns of the output and propagate the carry */
+    for (iy = 0; iy < pb; iy++) {
+      /* compute the column as a mp_word */
+      r       = ((mp_word)*tmpt) +
+                ((mp_word)tmpx) * ((mp_word)*tmpy++) +
+                ((mp_word) u);
+
+      /* the new column is the lower part of the result */
+      *tmpt++ = (mp_digit) (r & ((mp_word) MP_MASK));
+
+      /* get the carry word from the result */
+      u       = (mp_digit) (r >> ((mp_word) DIGIT_BIT));
+    }
+    /* set carry if it is placed below digs */
+    if (ix + iy < digs) {
+      *tmpt = u;
+    }
+  }
+
+  mp_clamp (&t);
+  mp_exch (&t, c);
+
+  mp_clear (&t);
+  return MP_OKAY;
+}
+
+int s_mp_mul_high_digs (mp_int * a, mp_int * b, mp_int * c, int digs)
+{
+  mp_int  t;
+  int     res, pa, pb, ix, iy;
+  mp_digit u;
+  mp_word r;
+  mp_digit tmpx, *tmpt, *tmpy;
+
+  if ((res = mp_init_size (&t, a->used + b->used + 1)) != MP_OKAY) {
+    return res;
+  }
+  t.used = a->used + b->used + 1;
+
+  pa = a->used;
+  pb = b->used;
+  for (ix = 0; ix < pa; ix++) {
+    /* clear the carry */
+    u = 0;
+
+    /* left hand side of A[ix] * B[iy] */
+    tmpx = a->dp[ix];
+
+    /* alias to the address of where the digits will be stored */
+    tmpt = &(t.dp[digs]);
+
+    /* alias for where to read the right hand side from */
+    tmpy = b->dp + (digs - ix);
+
+    for (iy = digs - ix; iy < pb; iy++) {
+      /* calculate the double precision result */
+      r       = ((mp_word)*tmpt) +
+                ((mp_word)tmpx) * ((mp_word)*tmpy++) +
+                ((mp_word) u);
+
+      /* get the lower part */
+      *tmpt++ = (mp_digit) (r & ((mp_word) MP_MASK));
+
+      /* carry the carry */
+      u       = (mp_digit) (r >> ((mp_word) DIGIT_BIT));
+    }
+    *tmpt = u;
+  }
+  mp_clamp (&t);
+  mp_exch (&t, c);
+  mp_clear (&t);
+  return MP_OKAY;
+}
+
+/* comba squaring, same as fast_s_mp_mul_digs except that every cross
+ * product a[i]*a[j] with i != j shows up twice in its column, so only
+ * half of them are summed and the column is doubled before the square
+ * term of even columns is added in
+ */
+int fast_s_mp_sqr (mp_int * a, mp_int * b)
+{
+  int       olduse, res, pa, ix, iz;
+  mp_digit  W[MP_WARRAY], *tmpx;
+  mp_word   W1;
+
+  /* grow the destination as required */
+  pa = a->used + a->used;
+  if (b->alloc < pa) {
+    if ((res = mp_grow (b, pa)) != MP_OKAY) {
+      return res;
+    }
+  }
+
+  /* number of output digits to produce */
+  W1 = 0;
+  for (ix = 0; ix < pa; ix++) { 
+      int      tx, ty, iy;
+      mp_word  _W;
+      mp_digit *tmpy;
+
+      /* clear counter */
+      _W = 0;
+
+      /* get offsets into the two bignums */
+      ty = MIN(a->used-1, ix);
+      tx = ix - ty;
+
+      /* setup temp aliases */
+      tmpx = a->dp + tx;
+      tmpy = a->dp + ty;
+
+      /* this is the number of times the loop will iterrate, essentially
+         while (tx++ < a->used && ty-- >= 0) { ... }
+       */
+      iy = MIN(a->used-tx, ty+1);
+
+      /* now for squaring tx can never equal ty 
+       * we halve the distance since they approach at a rate of 2x
+       * and we have to round because odd cases need to be executed
+       */
+      iy = MIN(iy, (ty-tx+1)>>1);
+
+      /* execute loop */
+      for (iz = 0; iz < iy; iz++) {
+         _W += ((mp_word)*tmpx++)*((mp_word)*tmpy--);
+      }
+
+      /* double the inner product and add carry */
+      _W = _W + _W + W1;
+
+      /* even columns have the square term in them */
+      if ((ix&1) == 0) {
+         _W += ((mp_word)a->dp[ix>>1])*((mp_word)a->dp[ix>>1]);
+      }
+
+      /* store it */
+      W[ix] = (mp_digit)(_W & MP_MASK);
+
+      /* make next carry */
+      W1 = _W >> ((mp_word)DIGIT_BIT);
+  }
+
+  /* setup dest */
+  olduse  = b->used;
+  b->used = a->used+a->used;
+
+  {
+    mp_digit *tmpb;
+    tmpb = b->dp;
+    for (ix = 0; ix < pa; ix++) {
+      *tmpb++ = W[ix] & MP_MASK;
+    }
+
+    /* clear unused digits [that existed in the old copy of c] */
+    for (; ix < olduse; ix++) {
+      *tmpb++ = 0;
+    }
+  }
+  mp_clamp (b);
+  return MP_OKAY;
+}
+
+/* c = |a| * |b| using Karatsuba Multiplication using 
+ * three half size multiplications
+ *
+ * Let B represent the radix [e.g. 2**DIGIT_BIT] and 
+ * let n represent half of the number of digits in 
+ * the min(a,b)
+ *
+ * a = a1 * B**n + a0
+ * b = b1 * B**n + b0
+ *
+ * Then, a * b => 
+   a1b1 * B**2n + ((a1 + a0)(b1 + b0) - (a0b0 + a1b1)) * B + a0b0
+ *
+ * Note that a1b1 and a0b0 are used twice and only need to be 
+ * computed once.  So in total three half size (half # of 
+ * digit) multiplications are performed, a0b0, a1b1 and 
+ * (a1+b1)(a0+b0)
+ *
+ * Note that a multiplication of half the digits requires
+ * 1/4th the number of single precision multiplications so in 
+ * total after one call 25% of the single precision multiplications 
+ * are saved.  Note also that the call to mp_mul can end up back 
+ * in this function if the a0, a1, b0, or b1 are above the threshold.  
+ * This is known as divide-and-conquer and leads to the famous 
+ * O(N**lg(3)) or O(N**1.584) work which is asymptopically lower than 
+ * the standard O(N**2) that the baseline/comba methods use.  
+ * Generally though the overhead of this method doesn't pay off 
+ * until a certain size (N ~ 80) is reached.
+ */
+int mp_karatsuba_mul (mp_int * a, mp_int * b, mp_int * c)
+{
+  mp_int  x0, x1, y0, y1, t1, x0y0, x1y1;
+  int     B, err;
+
+  /* default the return code to an error */
+  err = MP_MEM;
+
+  /* min # of digits */
+  B = MIN (a->used, b->used);
+
+  /* now divide in two */
+  B = B >> 1;
+
+  /* init copy all the temps */
+  if (mp_init_size (&x0, B) != MP_OKAY)
+    goto LBL_ERR;
+  if (mp_init_size (&x1, a->used - B) != MP_OKAY)
+    goto LBL_X0;
+  if (mp_init_size (&y0, B) != MP_OKAY)
+    goto LBL_X1;
+  if (mp_init_size (&y1, b->used - B) != MP_OKAY)
+    goto LBL_Y0;
+
+  /* init temps */
+  if (mp_init_size (&t1, B * 2) != MP_OKAY)
+    goto LBL_Y1;
+  if (mp_init_size (&x0y0, B * 2) != MP_OKAY)
+    goto LBL_T1;
+  if (mp_init_size (&x1y1, B * 2) != MP_OKAY)
+    goto LBL_X0Y0;
+
+  /* now shift the digits */
+  x0.used = y0.used = B;
+  x1.used = a->used - B;
+  y1.used = b->used - B;
+
+  {
+    register int x;
+    register mp_digit *tmpa, *tmpb, *tmpx, *tmpy;
+
+    /* we copy the digits directly instead of using higher level functions
+     * since we also need to shift the digits
+     */
+    tmpa = a->dp;
+    tmpb = b->dp;
+
+    tmpx = x0.dp;
+    tmpy = y0.dp;
+    for (x = 0; x < B; x++) {
+      *tmpx++ = *tmpa++;
+      *tmpy++ = *tmpb++;
+    }
+
+    tmpx = x1.dp;
+    for (x = B; x < a->used; x++) {
+      *tmpx++ = *tmpa++;
+    }
+
+    tmpy = y1.dp;
+    for (x = B; x < b->used; x++) {
+      *tmpy++ = *tmpb++;
+    }
+  }
+
+  /* only need to clamp the lower words since by definition the 
+   * upper words x1/y1 must have a known number of digits
+   */
+  mp_clamp (&x0);
+  mp_clamp (&y0);
+
+  /* now calc the products x0y0 and x1y1 */
+  /* after this x0 is no longer required, free temp [x0==t2]! */
+  if (mp_mul (&x0, &y0, &x0y0) != MP_OKAY)  
+    goto LBL_X1Y1;          /* x0y0 = x0*y0 */
+  if (mp_mul (&x1, &y1, &x1y1) != MP_OKAY)
+    goto LBL_X1Y1;          /* x1y1 = x1*y1 */
+
+  /* now calc x1+x0 and y1+y0 */
+  if (s_mp_add (&x1, &x0, &t1) != MP_OKAY)
+    goto LBL_X1Y1;          /* t1 = x1 + x0 */
+  if (s_mp_add (&y1, &y0, &x0) != MP_OKAY)
+    goto LBL_X1Y1;          /* t2 = y1 + y0 */
+  if (mp_mul (&t1, &x0, &t1) != MP_OKAY)
+    goto LBL_X1Y1;          /* t1 = (x1 + x0) * (y1 + y0) */
+
+  /* add x0y0 */
+  if (mp_add (&x0y0, &x1y1, &x0) != MP_OKAY)
+    goto LBL_X1Y1;          /* t2 = x0y0 + x1y1 */
+  if (s_mp_sub (&t1, &x0, &t1) != MP_OKAY)
+    goto LBL_X1Y1;          /* t1 = (x1+x0)*(y1+y0) - (x1y1 + x0y0) */
+
+  /* shift by B */
+  if (mp_lshd (&t1, B) != MP_OKAY)
+    goto LBL_X1Y1;          /* t1 = (x0y0 + x1y1 - (x1-x0)*(y1-y0))<<B */
+  if (mp_lshd (&x1y1, B * 2) != MP_OKAY)
+    goto LBL_X1Y1;          /* x1y1 = x1y1 << 2*B */
+
+  if (mp_add (&x0y0, &t1, &t1) != MP_OKAY)
+    goto LBL_X1Y1;          /* t1 = x0y0 + t1 */
+  if (mp_add (&t1, &x1y1, c) != MP_OKAY)
+    goto LBL_X1Y1;          /* t1 = x0y0 + t1 + x1y1 */
+
+  /* Algorithm succeeded set the return code to MP_OKAY */
+  err = MP_OKAY;
+
+LBL_X1Y1:mp_clear (&x1y1);
+LBL_X0Y0:mp_clear (&x0y0);
+LBL_T1:mp_clear (&t1);
+LBL_Y1:mp_clear (&y1);
+LBL_Y0:mp_clear (&y0);
+LBL_X1:mp_clear (&x1);
+LBL_X0:mp_clear (&x0);
+LBL_ERR:
+  return err;
+}
+
+/* Karatsuba squaring, computes b = a*a using three 
+ * half size squarings
+ *
+ * See comments of karatsuba_mul for details.  It 
+ * is essentially the same algorithm but merely 
+ * tuned to perform recursive squarings.
+ */
+int mp_karatsuba_sqr (mp_int * a, mp_int * b)
+{
+  mp_int  x0, x1, t1, t2, x0x0, x1x1;
+  int     B, err;
+
+  err = MP_MEM;
+
+  /* min # of digits */
+  B = a->used;
+
+  /* now divide in two */
+  B = B >> 1;
+
+  /* init copy all the temps */
+  if (mp_init_size (&x0, B) != MP_OKAY)
+    goto LBL_ERR;
+  if (mp_init_size (&x1, a->used - B) != MP_OKAY)
+    goto LBL_X0;
+
+  /* init temps */
+  if (mp_init_size (&t1, a->used * 2) != MP_OKAY)
+    goto LBL_X1;
+  if (mp_init_size (&t2, a->used * 2) != MP_OKAY)
+    goto LBL_T1;
+  if (mp_init_size (&x0x0, B * 2) != MP_OKAY)
+    goto LBL_T2;
+  if (mp_init_size (&x1x1, (a->used - B) * 2) != MP_OKAY)
+    goto LBL_X0X0;
+
+  {
+    register int x;
+    register mp_digit *dst, *src;
+
+    src = a->dp;
+
+    /* now shift the digits */
+    dst = x0.dp;
+    for (x = 0; x < B; x++) {
+      *dst++ = *src++;
+    }
+
+    dst = x1.dp;
+    for (x = B; x < a->used; x++) {
+      *dst++ = *src++;
+    }
+  }
+
+  x0.used = B;
+  x1.used = a->used - B;
+
+  mp_clamp (&x0);
+
+  /* now calc the products x0*x0 and x1*x1 */
+  if (mp_sqr (&x0, &x0x0) != MP_OKAY)
+    goto LBL_X1X1;           /* x0x0 = x0*x0 */
+  if (mp_sqr (&x1, &x1x1) != MP_OKAY)
+    goto LBL_X1X1;           /* x1x1 = x1*x1 */
+
+  /* now calc (x1+x0)**2 */
+  if (s_mp_add (&x1, &x0, &t1) != MP_OKAY)
+    goto LBL_X1X1;           /* t1 = x1 + x0 */
+  if (mp_sqr (&t1, &t1) != MP_OKAY)
+    goto LBL_X1X1;           /* t1 = (x1 + x0) * (x1 + x0) */
+
+  /* add x0y0 */
+  if (s_mp_add (&x0x0, &x1x1, &t2) != MP_OKAY)
+    goto LBL_X1X1;           /* t2 = x0x0 + x1x1 */
+  if (s_mp_sub (&t1, &t2, &t1) != MP_OKAY)
+    goto LBL_X1X1;           /* t1 = (x1+x0)**2 - (x0x0 + x1x1) */
+
+  /* shift by B */
+  if (mp_lshd (&t1, B) != MP_OKAY)
+    goto LBL_X1X1;           /* t1 = (x0x0 + x1x1 - (x1-x0)*(x1-x0))<<B */
+  if (mp_lshd (&x1x1, B * 2) != MP_OKAY)
+    goto LBL_X1X1;           /* x1x1 = x1x1 << 2*B */
+
+  if (mp_add (&x0x0, &t1, &t1) != MP_OKAY)
+    goto LBL_X1X1;           /* t1 = x0x0 + t1 */
+  if (mp_add (&t1, &x1x1, b) != MP_OKAY)
+    goto LBL_X1X1;           /* t1 = x0x0 + t1 + x1x1 */
+
+  err = MP_OKAY;
+
+LBL_X1X1:mp_clear (&x1x1);
+LBL_X0X0:mp_clear (&x0x0);
+LBL_T2:mp_clear (&t2);
+LBL_T1:mp_clear (&t1);
+LBL_X1:mp_clear (&x1);
+LBL_X0:mp_clear (&x0);
+LBL_ERR:
+  return err;
+}
+
+int s_mp_sqr (mp_int * a, mp_int * b)
+{
+  mp_int  t;
+  int     res, ix, iy, pa;
+  mp_word r;
+  mp_digit u, tmpx, *tmpt;
+
+  pa = a->used;
+  if ((res = mp_init_size (&t, 2*pa + 1)) != MP_OKAY) {
+    return res;
+  }
+
+  /* default used is maximum possible size */
+  t.used = 2*pa + 1;
 
-    /* zero the carry */
-    u = 0;
-    for (i = 0; i < min; i++) {
-      /* Compute the sum at one digit, T[i] = A[i] + B[i] + U */
-      *tmpc = *tmpa++ + *tmpb++ + u;
+  for (ix = 0; ix < pa; ix++) {
+    /* first calculate the digit at 2*ix */
+    /* calculate double precision result */
+    r = ((mp_word) t.dp[2*ix]) +
+        ((mp_word)a->dp[ix])*((mp_word)a->dp[ix]);
 
-      /* U = carry bit of T[i] */
-      u = *tmpc >> ((mp_digit)DIGIT_BIT);
+    /* store lower part in result */
+    t.dp[ix+ix] = (mp_digit) (r & ((mp_word) MP_MASK));
 
-      /* take away carry bit from T[i] */
-      *tmpc++ &= MP_MASK;
-    }
+    /* get the carry */
+    u           = (mp_digit)(r >> ((mp_word) DIGIT_BIT));
 
-    /* now copy higher words if any, that is in A+B 
-     * if A or B has more digits add those in 
-     */
-    if (min != max) {
-      for (; i < max; i++) {
-        /* T[i] = X[i] + U */
-        *tmpc = x->dp[i] + u;
+    /* left hand side of A[ix] * A[iy] */
+    tmpx        = a->dp[ix];
 
-        /* U = carry bit of T[i] */
-        u = *tmpc >> ((mp_digit)DIGIT_BIT);
+    /* alias for where to store the results */
+    tmpt        = t.dp + (2*ix + 1);
+    
+    for (iy = ix + 1; iy < pa; iy++) {
+      /* first calculate the product */
+      r       = ((mp_word)tmpx) * ((mp_word)a->dp[iy]);
 
-        /* take away carry bit from T[i] */
-        *tmpc++ &= MP_MASK;
-      }
-    }
+      /* now calculate the double precision result, note we use
+       * addition instead of *2 since it's easier to optimize
+       */
+      r       = ((mp_word) *tmpt) + r + r + ((mp_word) u);
 
-    /* add carry */
-    *tmpc++ = u;
+      /* store lower part */
+      *tmpt++ = (mp_digit) (r & ((mp_word) MP_MASK));
 
-    /* clear digits above oldused */
-    for (i = c->used; i < olduse; i++) {
-      *tmpc++ = 0;
+      /* get carry */
+      u       = (mp_digit)(r >> ((mp_word) DIGIT_BIT));
+    }
+    /* propagate upwards */
+    while (u != ((mp_digit) 0)) {
+      r       = ((mp_word) *tmpt) + ((mp_word) u);
+      *tmpt++ = (mp_digit) (r & ((mp_word) MP_MASK));
+      u       = (mp_digit)(r >> ((mp_word) DIGIT_BIT));
     }
   }
 
-  mp_clamp (c);
+  mp_clamp (&t);
+  mp_exch (&t, b);
+  mp_clear (&t);
   return MP_OKAY;
 }
 
-int s_mp_sub (mp_int * a, mp_int * b, mp_int * c)
+/* c = T mod n for the n->used + 1 digits of T, given T < 2n */
+static int s_mp_montgomery_fused_out (mp_digit * T, mp_int * n, mp_int * c)
 {
-  int     olduse, res, min, max;
+  int      ix, pa, res, olduse;
 
-  /* find sizes */
-  min = b->used;
-  max = a->used;
+  pa = n->used;
 
-  /* init result */
-  if (c->alloc < max) {
-    if ((res = mp_grow (c, max)) != MP_OKAY) {
+  /* grow the destination as required */
+  if (c->alloc < pa + 1) {
+    if ((res = mp_grow (c, pa + 1)) != MP_OKAY) {
       return res;
     }
   }
-  olduse = c->used;
-  c->used = max;
-
-  {
-    register mp_digit u, *tmpa, *tmpb, *tmpc;
-    register int i;
 
-    /* alias for digit pointers */
-    tmpa = a->dp;
-    tmpb = b->dp;
-    tmpc = c->dp;
+  olduse  = c->used;
+  c->used = pa + 1;
+  c->sign = MP_ZPOS;
+  for (ix = 0; ix <= pa; ix++) {
+    c->dp[ix] = T[ix];
+  }
+  for (; ix < olduse; ix++) {
+    c->dp[ix] = 0;
+  }
+  mp_clamp (c);
 
-    /* set carry to zero */
-    u = 0;
-    for (i = 0; i < min; i++) {
-      /* T[i] = A[i] - B[i] - U */
-      *tmpc = *tmpa++ - *tmpb++ - u;
+  /* the result is below 2n, so a single subtraction finishes the reduction */
+  if (mp_cmp_mag (c, n) != MP_LT) {
+    return s_mp_sub (c, n, c);
+  }
+  return MP_OKAY;
+}
 
-      /* U = carry bit of T[i]
-       * Note this saves performing an AND operation since
-       * if a carry does occur it will propagate all the way to the
-       * MSB.  As a result a single shift is enough to get the carry
-       */
-      u = *tmpc >> ((mp_digit)(CHAR_BIT * sizeof (mp_digit) - 1));
+/* computes c = a*b/R mod n with the multiplication and the Montgomery
+ * reduction fused in a single pass
+ *
+ * This is the product scanning (comba) flavour of the interleaved
+ * Montgomery multiplication, FIPS in the terms of Koc et al.: column k
+ * of a*b and column k of m*n are summed into the same accumulator, and
+ * the m[k] that clears the lowest digit of column k is picked as soon as
+ * the column is complete. There is no double width temporary at all,
+ * only the n digits of m and the n+1 digits of the result. Requires
+ * 0 <= a, b < n, and n->used below MP_FUSED_DIGITS so that the 2*n->used
+ * products of a column fit in a mp_word.
+ */
+int mp_montgomery_mul_fused (mp_int * a, mp_int * b, mp_int * n, mp_digit rho, mp_int * c)
+{
+  mp_digit A[MP_FUSED_DIGITS], B[MP_FUSED_DIGITS], M[MP_FUSED_DIGITS], T[MP_FUSED_DIGITS + 1];
+  mp_digit *tmpa, *tmpb, *tmpm, *tmpn;
+  mp_word  _W;
+  int      ix, iy, iz, tx, pa;
 
-      /* Clear carry from T[i] */
-      *tmpc++ &= MP_MASK;
-    }
+  pa = n->used;
+  if (pa >= MP_FUSED_DIGITS || a->used > pa || b->used > pa) {
+    return MP_VAL;
+  }
 
-    /* now copy higher words if any, e.g. if A has more digits than B  */
-    for (; i < max; i++) {
-      /* T[i] = A[i] - U */
-      *tmpc = *tmpa++ - u;
+  /* local copies, zero padded to the size of n */
+  for (ix = 0; ix < pa; ix++) {
+    A[ix] = (ix < a->used) ? a->dp[ix] : 0;
+    B[ix] = (ix < b->used) ? b->dp[ix] : 0;
+  }
 
-      /* U = carry bit of T[i] */
-      u = *tmpc >> ((mp_digit)(CHAR_BIT * sizeof (mp_digit) - 1));
+  _W = 0;
 
-      /* Clear carry from T[i] */
-      *tmpc++ &= MP_MASK;
+  /* lower half, every column also picks its digit of m */
+  for (ix = 0; ix < pa; ix++) {
+    tmpa = A;
+    tmpb = B + ix;
+    tmpm = M;
+    tmpn = n->dp + ix;
+    for (iz = 0; iz < ix; iz++) {
+      _W += ((mp_word)*tmpa++) * ((mp_word)*tmpb--);
+      _W += ((mp_word)*tmpm++) * ((mp_word)*tmpn--);
     }
-
-    /* clear digits above used (since we may not have grown result above) */
-    for (i = c->used; i < olduse; i++) {
-      *tmpc++ = 0;
+    _W += ((mp_word)*tmpa) * ((mp_word)*tmpb);
+
+    /* m[ix] makes the column a multiple of the radix */
+    M[ix] = (mp_digit) (((((mp_digit)_W) & MP_MASK) * rho) & MP_MASK);
+    _W   += ((mp_word)M[ix]) * ((mp_word)n->dp[0]);
+    _W  >>= ((mp_word) DIGIT_BIT);
+  }
+
+  /* upper half, these columns are the result */
+  for (ix = pa; ix < 2 * pa; ix++) {
+    tx   = ix - pa + 1;
+    iy   = pa - tx;
+    tmpa = A + tx;
+    tmpb = B + pa - 1;
+    tmpm = M + tx;
+    tmpn = n->dp + pa - 1;
+    for (iz = 0; iz < iy; iz++) {
+      _W += ((mp_word)*tmpa++) * ((mp_word)*tmpb--);
+      _W += ((mp_word)*tmpm++) * ((mp_word)*tmpn--);
     }
+    T[ix - pa] = (mp_digit) (_W & ((mp_word) MP_MASK));
+    _W       >>= ((mp_word) DIGIT_BIT);
   }
+  T[pa] = (mp_digit) _W;
 
-  mp_clamp (c);
-  return MP_OKAY;
+  return s_mp_montgomery_fused_out (T, n, c);
 }
 
-int fast_s_mp_mul_digs (mp_int * a, mp_int * b, mp_int * c, int digs)
+/* the squaring counterpart of mp_montgomery_mul_fused(), every cross
+ * product a[i]*a[j] with i != j is computed once and doubled, like in
+ * fast_s_mp_sqr(). Requires 0 <= a < n and n->used below MP_FUSED_DIGITS.
+ */
+int mp_montgomery_sqr_fused (mp_int * a, mp_int * n, mp_digit rho, mp_int * b)
 {
-  int     olduse, res, pa, ix, iz;
-  mp_digit W[MP_WARRAY];
-  register mp_word  _W;
+  mp_digit A[MP_FUSED_DIGITS], M[MP_FUSED_DIGITS], T[MP_FUSED_DIGITS + 1];
+  mp_digit *tmpx, *tmpy, *tmpm, *tmpn;
+  mp_word  _W, _S;
+  int      ix, iy, iz, tx, ty, pa;
 
-  /* grow the destination as required */
-  if (c->alloc < digs) {
-    if ((res = mp_grow (c, digs)) != MP_OKAY) {
-      return res;
-    }
+  pa = n->used;
+  if (pa >= MP_FUSED_DIGITS || a->used > pa) {
+    return MP_VAL;
   }
 
-  /* number of output digits to produce */
-  pa = MIN(digs, a->used + b->used);
+  /* local copy, zero padded to the size of n */
+  for (ix = 0; ix < pa; ix++) {
+    A[ix] = (ix < a->used) ? a->dp[ix] : 0;
+  }
 
-  /* clear the carry */
   _W = 0;
-  for (ix = 0; ix < pa; ix++) { 
-      int      tx, ty;
-      int      iy;
-      mp_digit *tmpx, *tmpy;
+  for (ix = 0; ix < 2 * pa; ix++) {
+    /* cross products of the column, see fast_s_mp_sqr() */
+    ty   = MIN(pa - 1, ix);
+    tx   = ix - ty;
+    iy   = MIN(pa - tx, ty + 1);
+    iy   = MIN(iy, (ty - tx + 1) >> 1);
+    tmpx = A + tx;
+    tmpy = A + ty;
+    _S   = 0;
+    for (iz = 0; iz < iy; iz++) {
+      _S += ((mp_word)*tmpx++) * ((mp_word)*tmpy--);
+    }
+    _W += _S + _S;
 
-      /* get offsets into the two bignums */
-      ty = MIN(b->used-1, ix);
-      tx = ix - ty;
+    /* even columns have the square term in them */
+    if ((ix & 1) == 0) {
+      _W += ((mp_word)A[ix >> 1]) * ((mp_word)A[ix >> 1]);
+    }
 
-      /* setup temp aliases */
-      tmpx = a->dp + tx;
-      tmpy = b->dp + ty;
+    /* the m*n products of the column */
+    tx   = (ix < pa) ? 0 : ix - pa + 1;
+    iy   = (ix < pa) ? ix : pa - tx;
+    tmpm = M + tx;
+    tmpn = n->dp + ix - tx;
+    for (iz = 0; iz < iy; iz++) {
+      _W += ((mp_word)*tmpm++) * ((mp_word)*tmpn--);
+    }
 
-      /* this is the number of times the loop will iterrate, essentially 
-         while (tx++ < a->used && ty-- >= 0) { ... }
-       */
-      iy = MIN(a->used-tx, ty+1);
+    if (ix < pa) {
+      /* m[ix] makes the column a multiple of the radix */
+      M[ix] = (mp_digit) (((((mp_digit)_W) & MP_MASK) * rho) & MP_MASK);
+      _W   += ((mp_word)M[ix]) * ((mp_word)n->dp[0]);
+    } else {
+      T[ix - pa] = (mp_digit) (_W & ((mp_word) MP_MASK));
+    }
+    _W >>= ((mp_word) DIGIT_BIT);
+  }
+  T[pa] = (mp_digit) _W;
 
-      /* execute loop */
-      for (iz = 0; iz < iy; ++iz) {
-         _W += ((mp_word)*tmpx++)*((mp_word)*tmpy--);
+  return s_mp_montgomery_fused_out (T, n, b);
+}
 
-      }
+#ifdef MP_64BIT
+/* The MP_REDUCE_MONT_R64 backend works on full radix 2**64 limbs rather
+ * than on DIGIT_BIT digits: a 2048-bit modulus takes 32 limbs instead of
+ * 35 and every carry is simply the upper half of a mp_word, nothing has to
+ * be masked off. Values in that representation are ordinary mp_int
+ * containers whose dp[] hold 64-bit limbs, only the functions below and
+ * mp_copy()/mp_exch() may be used on them. The same goes for the 52-bit
+ * limbs of MP_REDUCE_MONT_R52.
+ */
 
-      /* store term */
-      W[ix] = ((mp_digit)_W) & MP_MASK;
+/* c = the first n limbs of T */
+static int s_mp_set_limbs (mp_digit * T, int n, mp_int * c)
+{
+  int ix, res, olduse;
 
-      /* make next carry */
-      _W = _W >> ((mp_word)DIGIT_BIT);
- }
+  if (c->alloc < n) {
+    if ((res = mp_grow (c, n)) != MP_OKAY) {
+      return res;
+    }
+  }
 
-  /* setup dest */
   olduse  = c->used;
-  c->used = pa;
+  c->used = n;
+  c->sign = MP_ZPOS;
+  for (ix = 0; ix < n; ix++) {
+    c->dp[ix] = T[ix];
+  }
+  for (; ix < olduse; ix++) {
+    c->dp[ix] = 0;
+  }
+  mp_clamp (c);
+  return MP_OKAY;
+}
 
-  {
-    register mp_digit *tmpc;
-    tmpc = c->dp;
-    for (ix = 0; ix < pa+1; ix++) {
-      /* now extract the previous digit [below the carry] */
-      *tmpc++ = W[ix];
-    }
+/* b = |a| re-cut from limbs of from bits into limbs of to bits, both at most 64 */
+static int s_mp_repack (mp_int * a, int from, int to, mp_int * b)
+{
+  mp_digit L[2 * MP_FUSED_DIGITS], mask;
+  mp_word  acc;
+  int      ix, iy, bits;
 
-    /* clear unused digits [that existed in the old copy of c] */
-    for (; ix < olduse; ix++) {
-      *tmpc++ = 0;
+  if (a->used * from > MP_FUSED_DIGITS * MP_R64_BIT) {
+    return MP_VAL;
+  }
+
+  mask = (to == MP_R64_BIT) ? ~((mp_digit) 0) : (((mp_digit) 1) << to) - 1;
+  acc  = 0;
+  bits = 0;
+  for (ix = iy = 0; ix < a->used; ix++) {
+    acc  |= ((mp_word) a->dp[ix]) << bits;
+    bits += from;
+    while (bits >= to) {
+      L[iy++] = ((mp_digit) acc) & mask;
+      acc   >>= to;
+      bits   -= to;
     }
   }
-  mp_clamp (c);
+  if (bits > 0) {
+    L[iy++] = (mp_digit) acc;
+  }
+
+  return s_mp_set_limbs (L, iy, b);
+}
+
+/* b = |a| in limbs of the given size, 64 or 52 bits */
+int s_mp_pack_limbs (mp_int * a, int bits, mp_int * b)
+{
+  return s_mp_repack (a, DIGIT_BIT, bits, b);
+}
+
+/* b = a for a in limbs of the given size */
+int s_mp_unpack_limbs (mp_int * a, int bits, mp_int * b)
+{
+  return s_mp_repack (a, bits, DIGIT_BIT, b);
+}
+
+/* rho = -1/n mod 2**64 for n in 64-bit limbs, see mp_montgomery_setup() */
+int mp_montgomery_setup_r64 (mp_int * n, mp_digit * rho)
+{
+  mp_digit x, b;
+
+  b = n->dp[0];
+  if ((b & 1) == 0) {
+    return MP_VAL;
+  }
+
+  x = (((b + 2) & 4) << 1) + b; /* here x*a==1 mod 2**4 */
+  x *= 2 - b * x;               /* here x*a==1 mod 2**8 */
+  x *= 2 - b * x;               /* here x*a==1 mod 2**16 */
+  x *= 2 - b * x;               /* here x*a==1 mod 2**32 */
+  x *= 2 - b * x;               /* here x*a==1 mod 2**64 */
+
+  *rho = ((mp_digit) 0) - x;
   return MP_OKAY;
 }
 
-int s_mp_mul_digs (mp_int * a, mp_int * b, mp_int * c, int digs)
+/* c = T mod n for the n->used + 1 limbs of T, given T < 2n
+ *
+ * Both T and T - n are computed and the right one is picked with a mask,
+ * so the final subtraction costs the same whether it is needed or not.
+ */
+static int s_mp_montgomery_out_r64 (mp_digit * T, mp_int * n, mp_int * c)
 {
-  mp_int  t;
-  int     res, pa, pb, ix, iy;
-  mp_digit u;
-  mp_word r;
-  mp_digit tmpx, *tmpt, *tmpy;
+  mp_digit S[MP_FUSED_DIGITS], borrow, mask;
+  mp_word  r;
+  int      ix, pa;
 
-  /* can we use the fast multiplier? */
-  if (((digs) < MP_WARRAY) &&
-      MIN (a->used, b->used) < 
-          (1 << ((CHAR_BIT * sizeof (mp_word)) - (2 * DIGIT_BIT)))) {
-    return fast_s_mp_mul_digs (a, b, c, digs);
+  pa     = n->used;
+  borrow = 0;
+  for (ix = 0; ix < pa; ix++) {
+    r      = ((mp_word) T[ix]) - ((mp_word) n->dp[ix]) - ((mp_word) borrow);
+    S[ix]  = (mp_digit) r;
+    borrow = ((mp_digit) (r >> MP_R64_BIT)) & 1;
   }
 
-  if ((res = mp_init_size (&t, digs)) != MP_OKAY) {
-    return res;
+  /* T < n only if the subtraction borrowed and T has no top limb */
+  mask = ((mp_digit) 0) - (borrow & (T[pa] ^ 1));
+  for (ix = 0; ix < pa; ix++) {
+    S[ix] = (T[ix] & mask) | (S[ix] & ~mask);
   }
-  t.used = digs;
 
-  /* compute the digits of the product directly */
-  pa = a->used;
+  return s_mp_set_limbs (S, pa, c);
+}
+
+/* Montgomery reduction of the 2*n->used limbs of Q in place, the result
+ * is handed to s_mp_montgomery_out_r64(). The carry out of each row is
+ * kept in top and folded into the next one instead of being propagated.
+ */
+static int s_mp_montgomery_redc_r64 (mp_digit * Q, mp_int * n, mp_digit rho, mp_int * c)
+{
+  mp_digit *tmpq, *tmpn, m, u, top;
+  mp_word  r;
+  int      ix, iy, pa;
+
+  pa  = n->used;
+  top = 0;
   for (ix = 0; ix < pa; ix++) {
-    /* set the carry to zero */
-    u = 0;
+    m    = Q[ix] * rho;
+    u    = 0;
+    tmpq = Q + ix;
+    tmpn = n->dp;
+    for (iy = 0; iy < pa; iy++) {
+      r       = ((mp_word) *tmpq) + ((mp_word) m) * ((mp_word) *tmpn++) + ((mp_word) u);
+      *tmpq++ = (mp_digit) r;
+      u       = (mp_digit) (r >> MP_R64_BIT);
+    }
+    r     = ((mp_word) *tmpq) + ((mp_word) u) + ((mp_word) top);
+    *tmpq = (mp_digit) r;
+    top   = (mp_digit) (r >> MP_R64_BIT);
+  }
+  Q[2 * pa] = top;
 
-    /* limit ourselves to making digs digits of output */
-    pb = MIN (b->used, digs - ix);
+  return s_mp_montgomery_out_r64 (Q + pa, n, c);
+}
 
-    /* setup some aliases */
-    /* copy of the digit from a used within the nested loop */
-    tmpx = a->dp[ix];
-    
-    /* an alias for the destination shifted ix places */
-    tmpt = t.dp + ix;
-    
-    /* an alias for the digits of b */
-    tmpy = b->dp;
+/* (c2:acc) += x*y, the carry out of the 128-bit accumulator lands in c2
+ * without a branch */
+#define MP_R64_MAC(x, y)                              \
+  do {                                                \
+    mp_word _t = ((mp_word) (x)) * ((mp_word) (y));   \
+    acc += _t;                                        \
+    c2  += (mp_digit) (acc < _t);                     \
+  } while (0)
+
+/* (c2:acc) >>= 64 */
+#define MP_R64_SHIFT()                                          \
+  do {                                                          \
+    acc = (acc >> MP_R64_BIT) | (((mp_word) c2) << MP_R64_BIT); \
+    c2  = 0;                                                    \
+  } while (0)
+
+/* computes c = a*b/R mod n for a, b and n in 64-bit limbs and R = 2**(64*n->used)
+ *
+ * Same product scanning scheme as mp_montgomery_mul_fused(), but a column
+ * of full 64-bit products no longer fits a mp_word, so the accumulator is
+ * three limbs wide (acc plus the c2 limb on top). Requires 0 <= a, b < n.
+ */
+int mp_montgomery_mul_r64 (mp_int * a, mp_int * b, mp_int * n, mp_digit rho, mp_int * c)
+{
+  mp_digit A[MP_FUSED_DIGITS], B[MP_FUSED_DIGITS], M[MP_FUSED_DIGITS], T[MP_FUSED_DIGITS + 1];
+  mp_digit *tmpa, *tmpb, *tmpm, *tmpn, c2;
+  mp_word  acc;
+  int      ix, iy, iz, tx, pa;
 
-    /* compute the columns of the output and propagate the carry */
-    for (iy = 0; iy < pb; iy++) {
-      /* compute the column as a mp_word */
-      r       = ((mp_word)*tmpt) +
-                ((mp_word)tmpx) * ((mp_word)*tmpy++) +
-                ((mp_word) u);
+  pa = n->used;
+  if (pa >= MP_FUSED_DIGITS || a->used > pa || b->used > pa) {
+    return MP_VAL;
+  }
 
-      /* the new column is the lower part of the result */
-      *tmpt++ = (mp_digit) (r & ((mp_word) MP_MASK));
+  /* local copies, zero padded to the size of n */
+  for (ix = 0; ix < pa; ix++) {
+    A[ix] = (ix < a->used) ? a->dp[ix] : 0;
+    B[ix] = (ix < b->used) ? b->dp[ix] : 0;
+  }
 
-      /* get the carry word from the result */
-      u       = (mp_digit) (r >> ((mp_word) DIGIT_BIT));
+  acc = 0;
+  c2  = 0;
+
+  /* lower half, every column also picks its limb of m */
+  for (ix = 0; ix < pa; ix++) {
+    tmpa = A;
+    tmpb = B + ix;
+    tmpm = M;
+    tmpn = n->dp + ix;
+    for (iz = 0; iz < ix; iz++) {
+      MP_R64_MAC (*tmpa++, *tmpb--);
+      MP_R64_MAC (*tmpm++, *tmpn--);
     }
-    /* set carry if it is placed below digs */
-    if (ix + iy < digs) {
-      *tmpt = u;
+    MP_R64_MAC (*tmpa, *tmpb);
+
+    /* m[ix] makes the column a multiple of 2**64 */
+    M[ix] = ((mp_digit) acc) * rho;
+    MP_R64_MAC (M[ix], n->dp[0]);
+    MP_R64_SHIFT ();
+  }
+
+  /* upper half, these columns are the result */
+  for (ix = pa; ix < 2 * pa; ix++) {
+    tx   = ix - pa + 1;
+    iy   = pa - tx;
+    tmpa = A + tx;
+    tmpb = B + pa - 1;
+    tmpm = M + tx;
+    tmpn = n->dp + pa - 1;
+    for (iz = 0; iz < iy; iz++) {
+      MP_R64_MAC (*tmpa++, *tmpb--);
+      MP_R64_MAC (*tmpm++, *tmpn--);
     }
+    T[ix - pa] = (mp_digit) acc;
+    MP_R64_SHIFT ();
   }
+  T[pa] = (mp_digit) acc;
 
-  mp_clamp (&t);
-  mp_exch (&t, c);
-
-  mp_clear (&t);
-  return MP_OKAY;
+  return s_mp_montgomery_out_r64 (T, n, c);
 }
 
-int s_mp_mul_high_digs (mp_int * a, mp_int * b, mp_int * c, int digs)
+/* the squaring counterpart of mp_montgomery_mul_r64(), the cross products
+ * a[i]*a[j] with i != j are summed once into their own accumulator and
+ * doubled with a shift, like in mp_montgomery_sqr_fused(). Requires
+ * 0 <= a < n.
+ */
+int mp_montgomery_sqr_r64 (mp_int * a, mp_int * n, mp_digit rho, mp_int * b)
 {
-  mp_int  t;
-  int     res, pa, pb, ix, iy;
-  mp_digit u;
-  mp_word r;
-  mp_digit tmpx, *tmpt, *tmpy;
+  mp_digit A[MP_FUSED_DIGITS], M[MP_FUSED_DIGITS], T[MP_FUSED_DIGITS + 1];
+  mp_digit *tmpx, *tmpy, *tmpm, *tmpn, c2, s2;
+  mp_word  acc, s;
+  int      ix, iy, iz, tx, ty, pa;
 
-  if ((res = mp_init_size (&t, a->used + b->used + 1)) != MP_OKAY) {
-    return res;
+  pa = n->used;
+  if (pa >= MP_FUSED_DIGITS || a->used > pa) {
+    return MP_VAL;
   }
-  t.used = a->used + b->used + 1;
 
-  pa = a->used;
-  pb = b->used;
+  /* local copy, zero padded to the size of n */
   for (ix = 0; ix < pa; ix++) {
-    /* clear the carry */
-    u = 0;
-
-    /* left hand side of A[ix] * B[iy] */
-    tmpx = a->dp[ix];
-
-    /* alias to the address of where the digits will be stored */
-    tmpt = &(t.dp[digs]);
+    A[ix] = (ix < a->used) ? a->dp[ix] : 0;
+  }
+
+  acc = 0;
+  c2  = 0;
+  for (ix = 0; ix < 2 * pa; ix++) {
+    /* cross products of the column, see fast_s_mp_sqr() */
+    ty   = MIN(pa - 1, ix);
+    tx   = ix - ty;
+    iy   = MIN(pa - tx, ty + 1);
+    iy   = MIN(iy, (ty - tx + 1) >> 1);
+    tmpx = A + tx;
+    tmpy = A + ty;
+    s    = 0;
+    s2   = 0;
+    for (iz = 0; iz < iy; iz++) {
+      mp_word _t = ((mp_word) *tmpx++) * ((mp_word) *tmpy--);
+      s  += _t;
+      s2 += (mp_digit) (s < _t);
+    }
 
-    /* alias for where to read the right hand side from */
-    tmpy = b->dp + (digs - ix);
+    /* (c2:acc) += 2*(s2:s) */
+    s2   = (s2 << 1) | (mp_digit) (s >> (2 * MP_R64_BIT - 1));
+    s  <<= 1;
+    acc += s;
+    c2  += s2 + (mp_digit) (acc < s);
 
-    for (iy = digs - ix; iy < pb; iy++) {
-      /* calculate the double precision result */
-      r       = ((mp_word)*tmpt) +
-                ((mp_word)tmpx) * ((mp_word)*tmpy++) +
-                ((mp_word) u);
+    /* even columns have the square term in them */
+    if ((ix & 1) == 0) {
+      MP_R64_MAC (A[ix >> 1], A[ix >> 1]);
+    }
 
-      /* get the lower part */
-      *tmpt++ = (mp_digit) (r & ((mp_word) MP_MASK));
+    /* the m*n products of the column */
+    tx   = (ix < pa) ? 0 : ix - pa + 1;
+    iy   = (ix < pa) ? ix : pa - tx;
+    tmpm = M + tx;
+    tmpn = n->dp + ix - tx;
+    for (iz = 0; iz < iy; iz++) {
+      MP_R64_MAC (*tmpm++, *tmpn--);
+    }
 
-      /* carry the carry */
-      u       = (mp_digit) (r >> ((mp_word) DIGIT_BIT));
+    if (ix < pa) {
+      /* m[ix] makes the column a multiple of 2**64 */
+      M[ix] = ((mp_digit) acc) * rho;
+      MP_R64_MAC (M[ix], n->dp[0]);
+    } else {
+      T[ix - pa] = (mp_digit) acc;
     }
-    *tmpt = u;
+    MP_R64_SHIFT ();
   }
-  mp_clamp (&t);
-  mp_exch (&t, c);
-  mp_clear (&t);
-  return MP_OKAY;
+  T[pa] = (mp_digit) acc;
+
+  return s_mp_montgomery_out_r64 (T, n, b);
 }
 
-int s_mp_sqr (mp_int * a, mp_int * b)
+/* x = x/R mod n for x < n*R in 64-bit limbs */
+int mp_montgomery_reduce_r64 (mp_int * x, mp_int * n, mp_digit rho)
 {
-  mp_int  t;
-  int     res, ix, iy, pa;
-  mp_word r;
-  mp_digit u, tmpx, *tmpt;
+  mp_digit Q[2 * MP_FUSED_DIGITS + 1];
+  int      ix, pa;
 
-  pa = a->used;
-  if ((res = mp_init_size (&t, 2*pa + 1)) != MP_OKAY) {
-    return res;
+  pa = n->used;
+  if (pa >= MP_FUSED_DIGITS || x->used > 2 * pa) {
+    return MP_VAL;
   }
 
-  /* default used is maximum possible size */
-  t.used = 2*pa + 1;
+  for (ix = 0; ix <= 2 * pa; ix++) {
+    Q[ix] = (ix < x->used) ? x->dp[ix] : 0;
+  }
 
-  for (ix = 0; ix < pa; ix++) {
-    /* first calculate the digit at 2*ix */
-    /* calculate double precision result */
-    r = ((mp_word) t.dp[2*ix]) +
-        ((mp_word)a->dp[ix])*((mp_word)a->dp[ix]);
+  return s_mp_montgomery_redc_r64 (Q, n, rho, x);
+}
 
-    /* store lower part in result */
-    t.dp[ix+ix] = (mp_digit) (r & ((mp_word) MP_MASK));
+#else
+/* the full radix backend needs a 64-bit mp_digit and a 128-bit mp_word */
+int s_mp_pack_limbs (mp_int * a, int bits, mp_int * b)
+{
+  (void) a; (void) bits; (void) b;
+  return MP_VAL;
+}
 
-    /* get the carry */
-    u           = (mp_digit)(r >> ((mp_word) DIGIT_BIT));
+int s_mp_unpack_limbs (mp_int * a, int bits, mp_int * b)
+{
+  (void) a; (void) bits; (void) b;
+  return MP_VAL;
+}
 
-    /* left hand side of A[ix] * A[iy] */
-    tmpx        = a->dp[ix];
+int mp_montgomery_setup_r64 (mp_int * n, mp_digit * rho)
+{
+  (void) n; (void) rho;
+  return MP_VAL;
+}
 
-    /* alias for where to store the results */
-    tmpt        = t.dp + (2*ix + 1);
-    
-    for (iy = ix + 1; iy < pa; iy++) {
-      /* first calculate the product */
-      r       = ((mp_word)tmpx) * ((mp_word)a->dp[iy]);
+int mp_montgomery_mul_r64 (mp_int * a, mp_int * b, mp_int * n, mp_digit rho, mp_int * c)
+{
+  (void) a; (void) b; (void) n; (void) rho; (void) c;
+  return MP_VAL;
+}
 
-      /* now calculate the double precision result, note we use
-       * addition instead of *2 since it's easier to optimize
-       */
-      r       = ((mp_word) *tmpt) + r + r + ((mp_word) u);
+int mp_montgomery_sqr_r64 (mp_int * a, mp_int * n, mp_digit rho, mp_int * b)
+{
+  (void) a; (void) n; (void) rho; (void) b;
+  return MP_VAL;
+}
 
-      /* store lower part */
-      *tmpt++ = (mp_digit) (r & ((mp_word) MP_MASK));
+int mp_montgomery_reduce_r64 (mp_int * x, mp_int * n, mp_digit rho)
+{
+  (void) x; (void) n; (void) rho;
+  return MP_VAL;
+}
+#endif
 
-      /* get carry */
-      u       = (mp_digit)(r >> ((mp_word) DIGIT_BIT));
-    }
-    /* propagate upwards */
-    while (u != ((mp_digit) 0)) {
-      r       = ((mp_word) *tmpt) + ((mp_word) u);
-      *tmpt++ = (mp_digit) (r & ((mp_word) MP_MASK));
-      u       = (mp_digit)(r >> ((mp_word) DIGIT_BIT));
-    }
-  }
+#ifdef MP_HAVE_ADX
+/* one limb of MP_ADX_ROW(): dst[i] += lo with the carry in CF, and
+ * dst[i+1] += hi with the carry in OF */
+#define MP_ADX_STEP(i)                                    \
+  "mulxq " #i "*8(%[a]), %%r8, %%r9\n\t"                  \
+  "adcxq %%r11, %%r8\n\t"                                 \
+  "movq  %%r8, " #i "*8+%c[o](%[t])\n\t"                  \
+  "movq  " #i "*8+8(%[t]), %%r11\n\t"                     \
+  "adoxq %%r9, %%r11\n\t"
+
+/* dst[0..len+1] += src * mul for the len limbs of src, dst[len+1] must be
+ * 0 on entry and len a multiple of 4. With off = -8, limb i of the sum is
+ * stored to dst[i-1] instead, see s_mp_redc_row_adx().
+ *
+ * The low halves of the products are added with adcx (carry flag) and the
+ * high halves one limb higher with adox (overflow flag), so the two carry
+ * chains run side by side instead of serializing on a single flag. The
+ * loop is closed with lea/jrcxz, which leave both flags alone. Compilers
+ * turn _addcarryx_u64() back into a single adc chain, hence the asm.
+ */
+#define MP_ADX_ROW(dst, src, mul, len, off)                             \
+  do {                                                                  \
+    long _cnt = -(long) ((len) >> 2);                                   \
+    __asm__ __volatile__ (                                              \
+      "xorl  %%r10d, %%r10d\n\t"    /* r10 = 0, clears CF and OF */     \
+      "movq  (%[t]), %%r11\n"                                           \
+      "1:\n\t"                                                          \
+      MP_ADX_STEP(0) MP_ADX_STEP(1) MP_ADX_STEP(2) MP_ADX_STEP(3)       \
+      "leaq  32(%[a]), %[a]\n\t"                                        \
+      "leaq  32(%[t]), %[t]\n\t"                                        \
+      "leaq  1(%%rcx), %%rcx\n\t"                                       \
+      "jrcxz 2f\n\t"                                                    \
+      "jmp   1b\n"                                                      \
+      "2:\n\t"                                                          \
+      "adcxq %%r10, %%r11\n\t"      /* the last carries */              \
+      "movq  %%r11, %c[o](%[t])\n\t"                                    \
+      "movq  8(%[t]), %%r8\n\t"                                         \
+      "adoxq %%r10, %%r8\n\t"                                           \
+      "adcxq %%r10, %%r8\n\t"                                           \
+      "movq  %%r8, 8+%c[o](%[t])\n\t"                                   \
+      : [t] "+r" (dst), [a] "+r" (src), "+c" (_cnt)                     \
+      : "d" (mul), [o] "i" (off)                                        \
+      : "r8", "r9", "r10", "r11", "cc", "memory");                      \
+  } while (0)
+
+/* T[0..pa+1] += a * b, see MP_ADX_ROW() */
+static void s_mp_mac_row_adx (ulong64 * T, const ulong64 * a, ulong64 b, int pa)
+{
+  MP_ADX_ROW (T, a, b, pa, 0);
+}
 
-  mp_clamp (&t);
-  mp_exch (&t, b);
-  mp_clear (&t);
-  return MP_OKAY;
+/* T = (T + m*n) / 2**64 for the pa limbs of n, with m picked so that the
+ * division is exact. Limb i of the sum is stored to T[i-1] as soon as it
+ * is done, which saves shifting T afterwards; T[-1] must be writable.
+ */
+static void s_mp_redc_row_adx (ulong64 * T, const ulong64 * n, ulong64 rho, int pa)
+{
+  ulong64 m = T[0] * rho;
+
+  MP_ADX_ROW (T, n, m, pa, -8);
+  T[pa + 1] = 0;
 }
 
-int fast_mp_montgomery_reduce (mp_int * x, mp_int * n, mp_digit rho)
+/* mp_montgomery_mul_r64() on BMI2/ADX machines, see mp_cpu_kernel()
+ *
+ * Operand scanning (CIOS) this time: every row of a*b[i] is followed by
+ * the row of m*n that clears its lowest limb. With two independent carry
+ * chains this beats the product scanning C kernel, whose three-limb
+ * accumulator serializes every product on one carry. Requires
+ * 0 <= a, b < n and n->used a multiple of 4.
+ */
+int mp_montgomery_mul_r64_adx (mp_int * a, mp_int * b, mp_int * n, mp_digit rho, mp_int * c)
 {
-  int     ix, res, olduse;
-  mp_word W[MP_WARRAY];
+  ulong64  A[MP_FUSED_DIGITS], B[MP_FUSED_DIGITS], N[MP_FUSED_DIGITS], W[MP_FUSED_DIGITS + 3], *T;
+  mp_digit R[MP_FUSED_DIGITS + 1];
+  int      ix, pa;
 
-  /* get old used count */
-  olduse = x->used;
+  pa = n->used;
+  if (pa >= MP_FUSED_DIGITS || (pa & 3) != 0 || a->used > pa || b->used > pa) {
+    return MP_VAL;
+  }
 
-  /* grow a as required */
-  if (x->alloc < n->used + 1) {
-    if ((res = mp_grow (x, n->used + 1)) != MP_OKAY) {
-      return res;
-    }
+  /* local copies, zero padded to the size of n, T[-1] is scratch */
+  T = W + 1;
+  for (ix = 0; ix < pa; ix++) {
+    A[ix] = (ix < a->used) ? a->dp[ix] : 0;
+    B[ix] = (ix < b->used) ? b->dp[ix] : 0;
+    N[ix] = n->dp[ix];
+    T[ix] = 0;
   }
+  T[pa] = T[pa + 1] = 0;
 
-  /* first we have to get the digits of the input into
-   * an array of double precision words W[...]
-   */
-  {
-    register mp_word *_W;
-    register mp_digit *tmpx;
+  for (ix = 0; ix < pa; ix++) {
+    s_mp_mac_row_adx (T, A, B[ix], pa);
+    s_mp_redc_row_adx (T, N, rho, pa);
+  }
 
-    /* alias for the W[] array */
-    _W   = W;
+  for (ix = 0; ix <= pa; ix++) {
+    R[ix] = T[ix];
+  }
+  return s_mp_montgomery_out_r64 (R, n, c);
+}
 
-    /* alias for the digits of  x*/
-    tmpx = x->dp;
+/* b = a*a/R mod n, the squaring of mp_montgomery_mul_r64_adx() */
+int mp_montgomery_sqr_r64_adx (mp_int * a, mp_int * n, mp_digit rho, mp_int * b)
+{
+  return mp_montgomery_mul_r64_adx (a, a, n, rho, b);
+}
 
-    /* copy the digits of a into W[0..a->used-1] */
-    for (ix = 0; ix < x->used; ix++) {
-      *_W++ = *tmpx++;
-    }
+/* the MP_KERNEL_* flags of the kernels this CPU can run */
+int mp_cpu_kernel (void)
+{
+  unsigned int eax, ebx, ecx, edx, xcr0;
+  int          kernel = MP_KERNEL_C;
 
-    /* zero the high words of W[a->used..m->used*2] */
-    for (; ix < n->used * 2 + 1; ix++) {
-      *_W++ = 0;
-    }
+  /* leaf 1: the OS saves the extended state with xsave (OSXSAVE, bit 27 of ecx) */
+  if (__get_cpuid (1, &eax, &ebx, &ecx, &edx) == 0) {
+    return kernel;
+  }
+  xcr0 = 0;
+  if ((ecx & (1u << 27)) != 0) {
+    __asm__ __volatile__ ("xgetbv" : "=a" (xcr0), "=d" (edx) : "c" (0));
   }
 
-  /* now we proceed to zero successive digits
-   * from the least significant upwards
-   */
-  for (ix = 0; ix < n->used; ix++) {
-    /* mu = ai * m' mod b
-     *
-     * We avoid a double precision multiplication (which isn't required)
-     * by casting the value down to a mp_digit.  Note this requires
-     * that W[ix-1] have  the carry cleared (see after the inner loop)
-     */
-    register mp_digit mu;
-    mu = (mp_digit) (((W[ix] & MP_MASK) * rho) & MP_MASK);
-
-    /* a = a + mu * m * b**i
-     *
-     * This is computed in place and on the fly.  The multiplication
-     * by b**i is handled by offseting which columns the results
-     * are added to.
-     *
-     * Note the comba method normally doesn't handle carries in the
-     * inner loop In this case we fix the carry from the previous
-     * column since the Montgomery reduction requires digits of the
-     * result (so far) [see above] to work.  This is
-     * handled by fixing up one carry after the inner loop.  The
-     * carry fixups are done in order so after these loops the
-     * first m->used words of W[] have the carries fixed
-     */
-    {
-      register int iy;
-      register mp_digit *tmpn;
-      register mp_word *_W;
+  /* leaf 7: BMI2 is bit 8, AVX512F bit 16, ADX bit 19 and AVX512IFMA bit 21 of ebx */
+  if (__get_cpuid_count (7, 0, &eax, &ebx, &ecx, &edx) == 0) {
+    return kernel;
+  }
+  if ((ebx & (1u << 8)) != 0 && (ebx & (1u << 19)) != 0) {
+    kernel |= MP_KERNEL_ADX;
+  }
 
-      /* alias for the digits of the modulus */
-      tmpn = n->dp;
+  /* and the OS must save the SSE, AVX and the three AVX-512 states (XCR0 bits 1, 2, 5-7) */
+  if ((ebx & (1u << 16)) != 0 && (ebx & (1u << 21)) != 0 && (xcr0 & 0xE6) == 0xE6) {
+    kernel |= MP_KERNEL_IFMA;
+  }
+  return kernel;
+}
+#else
+int mp_montgomery_mul_r64_adx (mp_int * a, mp_int * b, mp_int * n, mp_digit rho, mp_int * c)
+{
+  (void) a; (void) b; (void) n; (void) rho; (void) c;
+  return MP_VAL;
+}
 
-      /* Alias for the columns set by an offset of ix */
-      _W = W + ix;
+int mp_montgomery_sqr_r64_adx (mp_int * a, mp_int * n, mp_digit rho, mp_int * b)
+{
+  (void) a; (void) n; (void) rho; (void) b;
+  return MP_VAL;
+}
 
-      /* inner loop */
-      for (iy = 0; iy < n->used; iy++) {
-          *_W++ += ((mp_word)mu) * ((mp_word)*tmpn++);
-      }
-    }
+int mp_cpu_kernel (void)
+{
+  return MP_KERNEL_C;
+}
+#endif
 
-    /* now fix carry for next digit, W[ix+1] */
-    W[ix + 1] += W[ix] >> ((mp_word) DIGIT_BIT);
-  }
+#ifdef MP_HAVE_IFMA
+/* c = T mod n for the n->used + 1 52-bit limbs of T, given T < 2n, with a
+ * masked final subtraction like s_mp_montgomery_out_r64() */
+static int s_mp_montgomery_out_r52 (ulong64 * T, mp_int * n, mp_int * c)
+{
+  mp_digit S[MP_R52_LIMBS + 1], mask, borrow;
+  ulong64  r;
+  int      ix, pa;
 
-  /* now we have to propagate the carries and
-   * shift the words downward [all those least
-   * significant digits we zeroed].
-   */
-  {
-    register mp_digit *tmpx;
-    register mp_word *_W, *_W1;
+  pa     = n->used;
+  borrow = 0;
+  for (ix = 0; ix <= pa; ix++) {
+    r      = T[ix] - ((ix < pa) ? n->dp[ix] : 0) - borrow;
+    S[ix]  = (mp_digit) (r & ((((ulong64) 1) << MP_R52_BIT) - 1));
+    borrow = (mp_digit) (r >> 63);
+  }
 
-    /* nox fix rest of carries */
+  /* T < n if the subtraction borrowed */
+  mask = ((mp_digit) 0) - borrow;
+  for (ix = 0; ix <= pa; ix++) {
+    S[ix] = (((mp_digit) T[ix]) & mask) | (S[ix] & ~mask);
+  }
 
-    /* alias for current word */
-    _W1 = W + ix;
+  return s_mp_set_limbs (S, pa + 1, c);
+}
 
-    /* alias for next word, where the carry goes */
-    _W = W + ++ix;
+/* computes c = a*b/R mod n for a, b and n in 52-bit limbs and R = 2**(52*n->used)
+ *
+ * AVX-512 IFMA engine, after Gueron and Krasnov. The running result lives
+ * in zmm registers, eight 52-bit limbs per register, each in a 64-bit lane
+ * with 12 spare bits. vpmadd52luq adds the low 52 bits of the products
+ * a[j]*b[i] and m*n[j] to lane j, the lowest lane is then a multiple of
+ * 2**52 and the whole vector moves down one lane, and vpmadd52huq adds the
+ * high 52 bits, which now land in the right lane. Carries between lanes
+ * are left in the spare bits and only propagated once, at the end: a lane
+ * gains less than 2**54 per row, so 128 rows still fit. Requires
+ * 0 <= a, b < n.
+ */
+__attribute__ ((target ("avx512f,avx512ifma")))
+int mp_montgomery_mul_r52_ifma (mp_int * a, mp_int * b, mp_int * n, mp_digit rho, mp_int * c)
+{
+  ulong64  A[MP_R52_LIMBS], B[MP_R52_LIMBS], N[MP_R52_LIMBS], T[MP_R52_LIMBS + 1], mask, carry, m;
+  __m512i  acc[MP_R52_LIMBS / 8], va[MP_R52_LIMBS / 8], vn[MP_R52_LIMBS / 8], vb, vm, zero;
+  int      ix, iy, pa, nv;
 
-    for (; ix <= n->used * 2 + 1; ix++) {
-      *_W++ += *_W1++ >> ((mp_word) DIGIT_BIT);
-    }
+  pa = n->used;
+  if (pa > MP_R52_LIMBS || a->used > pa || b->used > pa) {
+    return MP_VAL;
+  }
 
-    /* copy out, A = A/b**n
-     *
-     * The result is A/b**n but instead of converting from an
-     * array of mp_word to mp_digit than calling mp_rshd
-     * we just copy them in the right order
-     */
+  /* local copies, zero padded to a whole number of vectors */
+  nv = (pa + 7) >> 3;
+  for (ix = 0; ix < 8 * nv; ix++) {
+    A[ix] = (ix < a->used) ? a->dp[ix] : 0;
+    B[ix] = (ix < b->used) ? b->dp[ix] : 0;
+    N[ix] = (ix < pa) ? n->dp[ix] : 0;
+  }
 
-    /* alias for destination word */
-    tmpx = x->dp;
+  zero = _mm512_setzero_si512 ();
+  for (iy = 0; iy < nv; iy++) {
+    va[iy]  = _mm512_loadu_si512 (A + 8 * iy);
+    vn[iy]  = _mm512_loadu_si512 (N + 8 * iy);
+    acc[iy] = zero;
+  }
 
-    /* alias for shifted double precision result */
-    _W = W + n->used;
+  mask = (((ulong64) 1) << MP_R52_BIT) - 1;
+  for (ix = 0; ix < pa; ix++) {
+    /* m makes lane 0 a multiple of 2**52 once the low halves are in */
+    m  = (ulong64) _mm_cvtsi128_si64 (_mm512_castsi512_si128 (acc[0]));
+    m  = ((m + A[0] * B[ix]) * rho) & mask;
+    vb = _mm512_set1_epi64 ((long long) B[ix]);
+    vm = _mm512_set1_epi64 ((long long) m);
+
+    for (iy = 0; iy < nv; iy++) {
+      acc[iy] = _mm512_madd52lo_epu64 (acc[iy], va[iy], vb);
+      acc[iy] = _mm512_madd52lo_epu64 (acc[iy], vn[iy], vm);
+    }
 
-    for (ix = 0; ix < n->used + 1; ix++) {
-      *tmpx++ = (mp_digit)(*_W++ & ((mp_word) MP_MASK));
+    /* divide by 2**52: move every lane down one, carrying out of lane 0 */
+    carry = ((ulong64) _mm_cvtsi128_si64 (_mm512_castsi512_si128 (acc[0]))) >> MP_R52_BIT;
+    for (iy = 0; iy < nv - 1; iy++) {
+      acc[iy] = _mm512_alignr_epi64 (acc[iy + 1], acc[iy], 1);
     }
+    acc[nv - 1] = _mm512_alignr_epi64 (zero, acc[nv - 1], 1);
+    acc[0]      = _mm512_add_epi64 (acc[0], _mm512_maskz_set1_epi64 (1, (long long) carry));
 
-    /* zero oldused digits, if the input a was larger than
-     * m->used+1 we'll have to clear the digits
-     */
-    for (; ix < olduse; ix++) {
-      *tmpx++ = 0;
+    for (iy = 0; iy < nv; iy++) {
+      acc[iy] = _mm512_madd52hi_epu64 (acc[iy], va[iy], vb);
+      acc[iy] = _mm512_madd52hi_epu64 (acc[iy], vn[iy], vm);
     }
   }
 
-  /* set the max used and clamp */
-  x->used = n->used + 1;
-  mp_clamp (x);
+  for (iy = 0; iy < nv; iy++) {
+    _mm512_storeu_si512 (T + 8 * iy, acc[iy]);
+  }
 
-  /* if A >= m then A = A - m */
-  if (mp_cmp_mag (x, n) != MP_LT) {
-    return s_mp_sub (x, n, x);
+  /* propagate the carries left in the lanes, T < 2n fits pa + 1 limbs */
+  carry = 0;
+  for (ix = 0; ix < 8 * nv; ix++) {
+    T[ix] += carry;
+    carry  = T[ix] >> MP_R52_BIT;
+    T[ix] &= mask;
   }
-  return MP_OKAY;
+  T[8 * nv] = carry;
+
+  return s_mp_montgomery_out_r52 (T, n, c);
 }
 
-#define TAB_SIZE 256
-int mp_exptmod_fast (mp_int * G, mp_int * X, mp_int * P, mp_int * Y, int redmode)
+/* b = a*a/R mod n, the squaring of mp_montgomery_mul_r52_ifma() */
+int mp_montgomery_sqr_r52_ifma (mp_int * a, mp_int * n, mp_digit rho, mp_int * b)
 {
-  mp_int  M[TAB_SIZE], res;
-  mp_digit buf, mp;
-  int     err, bitbuf, bitcpy, bitcnt, mode, digidx, x, y, winsize;
+  return mp_montgomery_mul_r52_ifma (a, a, n, rho, b);
+}
 
-  /* use a pointer to the reduction algorithm.  This allows us to use
-   * one of many reduction algorithms without modding the guts of
-   * the code with if statements everywhere.
-   */
-  int     (*redux)(mp_int*,mp_int*,mp_digit);
+/* x = x/R mod n for x < n in 52-bit limbs, the way out of the Montgomery form */
+int mp_montgomery_reduce_r52_ifma (mp_int * x, mp_int * n, mp_digit rho)
+{
+  mp_int  one;
+  int     err;
 
-  /* find window size */
-  x = mp_count_bits (X);
-  if (x <= 7) {
-    winsize = 2;
-  } else if (x <= 36) {
-    winsize = 3;
-  } else if (x <= 140) {
-    winsize = 4;
-  } else if (x <= 450) {
-    winsize = 5;
-  } else if (x <= 1303) {
-    winsize = 6;
-  } else if (x <= 3529) {
-    winsize = 7;
-  } else {
-    winsize = 8;
+  if ((err = mp_init (&one)) != MP_OKAY) {
+    return err;
   }
+  mp_set (&one, 1);
+  err = mp_montgomery_mul_r52_ifma (x, &one, n, rho, x);
+  mp_clear (&one);
+  return err;
+}
 
-  /* init M array */
-  /* init first cell */
-  if ((err = mp_init(&M[1])) != MP_OKAY) {
-     return err;
+/* computes c = a*b/R mod n for MP_R52_LANES independent pairs at once, the
+ * lane-parallel form of mp_montgomery_mul_r52_ifma().
+ *
+ * The operands are a structure of arrays: a[j] holds limb j of the a of
+ * every lane, and n[j] limb j of the modulus, the same in every lane. Here
+ * nothing ever moves between lanes, each row is a plain schoolbook pass
+ * where the low halves of a[j]*b[i] and m*n[j] go to T[i+j] and the high
+ * halves to T[i+j+1], with m worked out per lane from T[i]. As in the
+ * single value engine a limb gains less than 2**54 per row and the carries
+ * wait in the spare bits until the end. Requires 0 <= a, b < n in every
+ * lane, c may be a or b.
+ */
+__attribute__ ((target ("avx512f,avx512ifma")))
+static void s_mp_montgomery_mul_r52x8 (__m512i * a, __m512i * b, __m512i * n, __m512i rho, int pa, __m512i * c)
+{
+  __m512i  T[2 * MP_R52_LIMBS], lo, hi, vb, vm, carry, mask, zero;
+  __mmask8 keep;
+  int      ix, iy;
+
+  zero = _mm512_setzero_si512 ();
+  mask = _mm512_set1_epi64 ((long long) ((((ulong64) 1) << MP_R52_BIT) - 1));
+  for (ix = 0; ix <= pa; ix++) {
+    T[ix] = zero;
   }
 
-  /* now init the second half of the array */
-  for (x = 1<<(winsize-1); x < (1 << winsize); x++) {
-    if ((err = mp_init(&M[x])) != MP_OKAY) {
-      for (y = 1<<(winsize-1); y < x; y++) {
-        mp_clear (&M[y]);
-      }
-      mp_clear(&M[1]);
-      return err;
+  for (ix = 0; ix < pa; ix++) {
+    /* m makes T[ix] a multiple of 2**52 in every lane */
+    vb    = b[ix];
+    lo    = _mm512_madd52lo_epu64 (T[ix], a[0], vb);
+    vm    = _mm512_madd52lo_epu64 (zero, lo, rho);
+    lo    = _mm512_madd52lo_epu64 (lo, n[0], vm);
+    carry = _mm512_srli_epi64 (lo, MP_R52_BIT);
+
+    for (iy = 1; iy < pa; iy++) {
+      lo = _mm512_madd52lo_epu64 (T[ix + iy], a[iy], vb);
+      hi = _mm512_madd52hi_epu64 (zero, a[iy - 1], vb);
+      lo = _mm512_madd52lo_epu64 (lo, n[iy], vm);
+      hi = _mm512_madd52hi_epu64 (hi, n[iy - 1], vm);
+      T[ix + iy] = _mm512_add_epi64 (lo, hi);
     }
+    hi = _mm512_madd52hi_epu64 (zero, a[pa - 1], vb);
+    T[ix + pa] = _mm512_madd52hi_epu64 (hi, n[pa - 1], vm);
+    T[ix + 1]  = _mm512_add_epi64 (T[ix + 1], carry);
   }
 
-  /* determine and setup reduction code */
-  if (redmode == 0) {
-     /* now setup montgomery  */
-     if ((err = mp_montgomery_setup (P, &mp)) != MP_OKAY) {
-        goto LBL_M;
-     }
-
-     /* automatically pick the comba one if available (saves quite a few calls/ifs) */
-     if (((P->used * 2 + 1) < MP_WARRAY) &&
-          P->used < (1 << ((CHAR_BIT * sizeof (mp_word)) - (2 * DIGIT_BIT)))) {
-        redux = fast_mp_montgomery_reduce;
-     } else 
-     {
-        /* use slower baseline Montgomery method */
-        redux = mp_montgomery_reduce;
-     }
-  } else if (redmode == 1) {
-     /* setup DR reduction for moduli of the form B**k - b */
-     mp_dr_setup(P, &mp);
-     redux = mp_dr_reduce;
-  } else {
-     /* setup DR reduction for moduli of the form 2**k - b */
-     if ((err = mp_reduce_2k_setup(P, &mp)) != MP_OKAY) {
-        goto LBL_M;
-     }
-     redux = mp_reduce_2k;
+  /* propagate the carries of the upper half, T < 2n fits pa + 1 limbs */
+  carry = zero;
+  for (ix = pa; ix < 2 * pa; ix++) {
+    T[ix] = _mm512_add_epi64 (T[ix], carry);
+    carry = _mm512_srli_epi64 (T[ix], MP_R52_BIT);
+    T[ix] = _mm512_and_si512 (T[ix], mask);
   }
 
-  /* setup result */
-  if ((err = mp_init (&res)) != MP_OKAY) {
-    goto LBL_M;
+  /* c = T - n, or T in the lanes where that borrows */
+  lo = zero;
+  for (ix = 0; ix < pa; ix++) {
+    hi    = _mm512_sub_epi64 (_mm512_sub_epi64 (T[pa + ix], n[ix]), lo);
+    lo    = _mm512_srli_epi64 (hi, 63);
+    c[ix] = _mm512_and_si512 (hi, mask);
   }
+  keep = _mm512_cmpgt_epu64_mask (lo, carry);
+  for (ix = 0; ix < pa; ix++) {
+    c[ix] = _mm512_mask_blend_epi64 (keep, c[ix], T[pa + ix]);
+  }
+}
 
-  /* create M table
-   *
-
-   *
-   * The first half of the table is not computed though accept for M[0] and M[1]
-   */
+/* one base of s_mp_ctx_exptmod2_r52x8(), either a comb table or the powers
+ * G**0 ... G**(2**winsize - 1) of a fixed window, the entries flattened to
+ * pa zero padded limbs each */
+typedef struct {
+  ulong64 *tab;
+  int      teeth;    /* 0 for a fixed window */
+  int      spacing;
+  int      winsize;
+  int      len;      /* number of squarings this base needs */
+} s_mp_lane_term;
+
+static int s_mp_lane_term_init (s_mp_lane_term * t, mp_int * G, mp_comb * T, mp_int * X, int n, mp_mod_ctx * c)
+{
+  mp_int *E = NULL;
+  int     err, x, y, pa, bits, size;
 
-  if (redmode == 0) {
-     /* now we need R mod m */
-     if ((err = mp_montgomery_calc_normalization (&res, P)) != MP_OKAY) {
-       goto LBL_RES;
-     }
+  for (bits = 0, x = 0; x < n; x++) {
+    bits = MAX(bits, mp_count_bits (&X[x]));
+  }
 
-     /* now set M[1] to G * R mod m */
-     if ((err = mp_mulmod (G, &res, P, &M[1])) != MP_OKAY) {
-       goto LBL_RES;
-     }
+  t->teeth   = 0;
+  t->winsize = 0;
+  if (T != NULL && bits <= T->teeth * T->spacing) {
+    t->teeth   = T->teeth;
+    t->spacing = T->spacing;
+    t->len     = T->spacing;
+    size       = 1 << T->teeth;
+    E          = T->T;
   } else {
-     mp_set(&res, 1);
-     if ((err = mp_mod(G, P, &M[1])) != MP_OKAY) {
-        goto LBL_RES;
-     }
+    /* every lane multiplies at the same bits, so the windows are fixed
+     * rather than sliding and the table holds the even powers too */
+    if (bits <= 32) {
+      t->winsize = 2;
+    } else if (bits <= 128) {
+      t->winsize = 3;
+    } else if (bits <= 320) {
+      t->winsize = 4;
+    } else if (bits <= 768) {
+      t->winsize = 5;
+    } else {
+      t->winsize = 6;
+    }
+    t->len = ((bits + t->winsize - 1) / t->winsize) * t->winsize;
+    size   = 1 << t->winsize;
   }
 
-  /* compute the value at M[1<<(winsize-1)] by squaring M[1] (winsize-1) times */
-  if ((err = mp_copy (&M[1], &M[1 << (winsize - 1)])) != MP_OKAY) {
-    goto LBL_RES;
+  pa     = c->N.used;
+  t->tab = OPT_CAST(ulong64) XMALLOC (sizeof (ulong64) * (size_t)size * (size_t)pa);
+  if (t->tab == NULL) {
+    return MP_MEM;
   }
 
-  for (x = 0; x < (winsize - 1); x++) {
-    if ((err = mp_sqr (&M[1 << (winsize - 1)], &M[1 << (winsize - 1)])) != MP_OKAY) {
-      goto LBL_RES;
+  if (E == NULL) {
+    E = OPT_CAST(mp_int) XMALLOC (sizeof (mp_int) * (size_t)size);
+    if (E == NULL) {
+      err = MP_MEM;
+      goto LBL_TAB;
     }
-    if ((err = redux (&M[1 << (winsize - 1)], P, mp)) != MP_OKAY) {
-      goto LBL_RES;
+    for (x = 0; x < size; x++) {
+      if ((err = mp_init (&E[x])) != MP_OKAY) {
+        while (x-- > 0) {
+          mp_clear (&E[x]);
+        }
+        XFREE (E);
+        goto LBL_TAB;
+      }
     }
-  }
 
-  /* create upper table */
-  for (x = (1 << (winsize - 1)) + 1; x < (1 << winsize); x++) {
-    if ((err = mp_mul (&M[x - 1], &M[1], &M[x])) != MP_OKAY) {
-      goto LBL_RES;
+    /* E[x] = G**x */
+    if ((err = mp_copy (&c->R, &E[0])) != MP_OKAY) {
+      goto LBL_E;
     }
-    if ((err = redux (&M[x], P, mp)) != MP_OKAY) {
-      goto LBL_RES;
+    if ((err = mp_copy (G, &E[1])) != MP_OKAY) {
+      goto LBL_E;
+    }
+    for (x = 2; x < size; x++) {
+      if ((err = s_mp_ctx_mul (&E[x - 1], G, c, &E[x])) != MP_OKAY) {
+        goto LBL_E;
+      }
     }
   }
 
-  /* set initial mode and bit cnt */
-  mode   = 0;
-  bitcnt = 1;
-  buf    = 0;
-  digidx = X->used - 1;
-  bitcpy = 0;
-  bitbuf = 0;
+  for (err = MP_OKAY, x = 0; x < size; x++) {
+    if (E[x].used > pa) {
+      err = MP_VAL;
+      break;
+    }
+    for (y = 0; y < pa; y++) {
+      t->tab[x * pa + y] = (y < E[x].used) ? E[x].dp[y] : 0;
+    }
+  }
 
-  for (;;) {
-    /* grab next digit as required */
-    if (--bitcnt == 0) {
-      /* if digidx == -1 we are out of digits so break */
-      if (digidx == -1) {
-        break;
-      }
-      /* read next digit and reset bitcnt */
-      buf    = X->dp[digidx--];
-      bitcnt = (int)DIGIT_BIT;
+LBL_E:
+  if (t->teeth == 0) {
+    for (x = 0; x < size; x++) {
+      mp_clear (&E[x]);
     }
+    XFREE (E);
+  }
+  if (err == MP_OKAY) {
+    return MP_OKAY;
+  }
+LBL_TAB:
+  XFREE (t->tab);
+  t->tab = NULL;
+  return err;
+}
 
-    /* grab the next msb from the exponent */
-    y     = (mp_digit)(buf >> (DIGIT_BIT - 1)) & 1;
-    buf <<= (mp_digit)1;
+/* table entries of the multipliers of the given lanes at bit x of the chain,
+ * returns 0 when no lane multiplies there */
+static int s_mp_lane_term_step (s_mp_lane_term * t, mp_int * X, int lanes, int x, long long * idx)
+{
+  int l, y, any;
 
-    /* if the bit is zero and mode == 0 then we ignore it
-     * These represent the leading zero bits before the first 1 bit
-     * in the exponent.  Technically this opt is not required but it
-     * does lower the # of trivial squaring/reductions used
-     */
-    if (mode == 0 && y == 0) {
+  if (x >= t->len || (t->teeth == 0 && (x % t->winsize) != 0)) {
+    return 0;
+  }
+
+  for (any = 0, l = 0; l < MP_R52_LANES; l++) {
+    idx[l] = 0;
+    if (l >= lanes) {
       continue;
     }
-
-    /* if the bit is zero and mode == 1 then we square */
-    if (mode == 1 && y == 0) {
-      if ((err = mp_sqr (&res, &res)) != MP_OKAY) {
-        goto LBL_RES;
+    if (t->teeth != 0) {
+      for (y = 0; y < t->teeth; y++) {
+        idx[l] |= (long long) s_mp_get_bit (&X[l], y * t->spacing + x) << y;
       }
-      if ((err = redux (&res, P, mp)) != MP_OKAY) {
-        goto LBL_RES;
+    } else {
+      for (y = 0; y < t->winsize; y++) {
+        idx[l] |= (long long) s_mp_get_bit (&X[l], x + y) << y;
       }
-      continue;
     }
+    any |= (idx[l] != 0);
+  }
+  return any;
+}
 
-    /* else we add it to the window */
-    bitbuf |= (y << (winsize - ++bitcpy));
-    mode    = 2;
-
-    if (bitcpy == winsize) {
-      /* ok window is filled so square as required and multiply  */
-      /* square first */
-      for (x = 0; x < winsize; x++) {
-        if ((err = mp_sqr (&res, &res)) != MP_OKAY) {
-          goto LBL_RES;
-        }
-        if ((err = redux (&res, P, mp)) != MP_OKAY) {
-          goto LBL_RES;
-        }
-      }
+/* s_mp_ctx_exptmod2_lanes() on the IFMA engine, MP_R52_LANES values at a
+ * time. The lanes run the same chain of squarings in lockstep and gather
+ * their own table entry for every multiplication. */
+__attribute__ ((target ("avx512f,avx512ifma")))
+static int s_mp_ctx_exptmod2_r52x8 (mp_int * G1, mp_comb * T1, mp_int * X1, mp_int * G2, mp_comb * T2, mp_int * X2, int n, mp_mod_ctx * c, mp_int * Y)
+{
+  s_mp_lane_term t[2];
+  __m512i   acc[MP_R52_LIMBS], B[MP_R52_LIMBS], N[MP_R52_LIMBS], rho, vidx, one;
+  ulong64   L[8 * MP_R52_LIMBS];
+  mp_digit  S[MP_R52_LIMBS];
+  long long idx[MP_R52_LANES];
+  int       err, g, x, y, l, iy, pa, lanes, len, started;
+
+  pa = c->N.used;
+  if (pa > MP_R52_LIMBS) {
+    return MP_VAL;
+  }
 
-      /* then multiply */
-      if ((err = mp_mul (&res, &M[bitbuf], &res)) != MP_OKAY) {
-        goto LBL_RES;
-      }
-      if ((err = redux (&res, P, mp)) != MP_OKAY) {
-        goto LBL_RES;
-      }
+  if ((err = s_mp_lane_term_init (&t[0], G1, T1, X1, n, c)) != MP_OKAY) {
+    return err;
+  }
+  if ((err = s_mp_lane_term_init (&t[1], G2, T2, X2, n, c)) != MP_OKAY) {
+    goto LBL_T0;
+  }
 
-      /* empty window and reset */
-      bitcpy = 0;
-      bitbuf = 0;
-      mode   = 1;
-    }
+  for (iy = 0; iy < pa; iy++) {
+    N[iy] = _mm512_set1_epi64 ((long long) c->N.dp[iy]);
   }
+  rho = _mm512_set1_epi64 ((long long) c->rho);
+  one = _mm512_set1_epi64 (1);
+  len = MAX(t[0].len, t[1].len);
 
-  /* if bits remain then square/multiply */
-  if (mode == 2 && bitcpy > 0) {
-    /* square then multiply if the bit is set */
-    for (x = 0; x < bitcpy; x++) {
-      if ((err = mp_sqr (&res, &res)) != MP_OKAY) {
-        goto LBL_RES;
-      }
-      if ((err = redux (&res, P, mp)) != MP_OKAY) {
-        goto LBL_RES;
+  for (g = 0; g < n; g += MP_R52_LANES) {
+    lanes = MIN(n - g, MP_R52_LANES);
+
+    started = 0;
+    for (x = len - 1; x >= 0; x--) {
+      if (started) {
+        s_mp_montgomery_mul_r52x8 (acc, acc, N, rho, pa, acc);
       }
 
-      /* get next bit of the window */
-      bitbuf <<= 1;
-      if ((bitbuf & (1 << winsize)) != 0) {
-        /* then multiply */
-        if ((err = mp_mul (&res, &M[1], &res)) != MP_OKAY) {
-          goto LBL_RES;
+      for (y = 0; y < 2; y++) {
+        if (s_mp_lane_term_step (&t[y], (y == 0) ? X1 + g : X2 + g, lanes, x, idx) == 0) {
+          continue;
         }
-        if ((err = redux (&res, P, mp)) != MP_OKAY) {
-          goto LBL_RES;
+
+        /* limb iy of lane l's entry is tab[idx[l]*pa + iy] */
+        vidx = _mm512_mullox_epi64 (_mm512_loadu_si512 (idx), _mm512_set1_epi64 (pa));
+        for (iy = 0; iy < pa; iy++) {
+          B[iy] = _mm512_i64gather_epi64 (vidx, (void *) t[y].tab, 8);
+          vidx  = _mm512_add_epi64 (vidx, one);
+        }
+
+        if (started) {
+          s_mp_montgomery_mul_r52x8 (acc, B, N, rho, pa, acc);
+        } else {
+          for (iy = 0; iy < pa; iy++) {
+            acc[iy] = B[iy];
+          }
         }
+        started = 1;
       }
     }
-  }
 
-  if (redmode == 0) {
-     /* fixup result if Montgomery reduction is used
-      * recall that any value in a Montgomery system is
-      * actually multiplied by R mod n.  So we have
-      * to reduce one more time to cancel out the factor
-      * of R.
-      */
-     if ((err = redux(&res, P, mp)) != MP_OKAY) {
-       goto LBL_RES;
-     }
+    /* every exponent of the group was zero */
+    if (started == 0) {
+      for (iy = 0; iy < pa; iy++) {
+        acc[iy] = _mm512_set1_epi64 ((long long) ((iy < c->R.used) ? c->R.dp[iy] : 0));
+      }
+    }
+
+    for (iy = 0; iy < pa; iy++) {
+      _mm512_storeu_si512 (L + 8 * iy, acc[iy]);
+    }
+    for (l = 0; l < lanes; l++) {
+      for (iy = 0; iy < pa; iy++) {
+        S[iy] = (mp_digit) L[8 * iy + l];
+      }
+      if ((err = s_mp_set_limbs (S, pa, &Y[g + l])) != MP_OKAY) {
+        goto LBL_T1;
+      }
+    }
   }
 
-  /* swap res with Y */
-  mp_exch (&res, Y);
   err = MP_OKAY;
-LBL_RES:mp_clear (&res);
-LBL_M:
-  mp_clear(&M[1]);
-  for (x = 1<<(winsize-1); x < (1 << winsize); x++) {
-    mp_clear (&M[x]);
-  }
+LBL_T1:
+  XFREE (t[1].tab);
+LBL_T0:
+  XFREE (t[0].tab);
   return err;
 }
+#else
+static int s_mp_ctx_exptmod2_r52x8 (mp_int * G1, mp_comb * T1, mp_int * X1, mp_int * G2, mp_comb * T2, mp_int * X2, int n, mp_mod_ctx * c, mp_int * Y)
+{
+  (void) G1; (void) T1; (void) X1; (void) G2; (void) T2; (void) X2; (void) n; (void) c; (void) Y;
+  return MP_VAL;
+}
+
+int mp_montgomery_mul_r52_ifma (mp_int * a, mp_int * b, mp_int * n, mp_digit rho, mp_int * c)
+{
+  (void) a; (void) b; (void) n; (void) rho; (void) c;
+  return MP_VAL;
+}
+
+int mp_montgomery_sqr_r52_ifma (mp_int * a, mp_int * n, mp_digit rho, mp_int * b)
+{
+  (void) a; (void) n; (void) rho; (void) b;
+  return MP_VAL;
+}
 
-int s_mp_exptmod (mp_int * G, mp_int * X, mp_int * P, mp_int * Y, int redmode)
+int mp_montgomery_reduce_r52_ifma (mp_int * x, mp_int * n, mp_digit rho)
 {
-  mp_int  M[TAB_SIZE], res, mu;
-  mp_digit buf;
-  int     err, bitbuf, bitcpy, bitcnt, mode, digidx, x, y, winsize;
-  int (*redux)(mp_int*,mp_int*,mp_int*);
+  (void) x; (void) n; (void) rho;
+  return MP_VAL;
+}
+#endif
 
-  /* find window size */
-  x = mp_count_bits (X);
-  if (x <= 7) {
-    winsize = 2;
-  } else if (x <= 36) {
-    winsize = 3;
-  } else if (x <= 140) {
-    winsize = 4;
-  } else if (x <= 450) {
-    winsize = 5;
-  } else if (x <= 1303) {
-    winsize = 6;
-  } else if (x <= 3529) {
-    winsize = 7;
-  } else {
-    winsize = 8;
+/* Y[k] = G1**X1[k] * G2**X2[k] for every k < n, the same bases and tables
+ * with n different pairs of exponents. Inputs and results are in the
+ * representation of c, as for s_mp_ctx_exptmod2(). With the IFMA engine
+ * the values go MP_R52_LANES at a time, one per 64-bit lane, otherwise one
+ * after the other. */
+int s_mp_ctx_exptmod2_lanes (mp_int * G1, mp_comb * T1, mp_int * X1, mp_int * G2, mp_comb * T2, mp_int * X2, int n, mp_mod_ctx * c, mp_int * Y)
+{
+  int err, k;
+
+  for (k = 0; k < n; k++) {
+    if (X1[k].sign == MP_NEG || X2[k].sign == MP_NEG) {
+      return MP_VAL;
+    }
   }
 
-  /* init M array */
-  /* init first cell */
-  if ((err = mp_init(&M[1])) != MP_OKAY) {
-     return err; 
+  if (n > 1 && c->mode == MP_REDUCE_MONT_R52 && (c->kernel & MP_KERNEL_IFMA) != 0) {
+    return s_mp_ctx_exptmod2_r52x8 (G1, T1, X1, G2, T2, X2, n, c, Y);
   }
 
-  /* now init the second half of the array */
-  for (x = 1<<(winsize-1); x < (1 << winsize); x++) {
-    if ((err = mp_init(&M[x])) != MP_OKAY) {
-      for (y = 1<<(winsize-1); y < x; y++) {
-        mp_clear (&M[y]);
-      }
-      mp_clear(&M[1]);
+  for (k = 0; k < n; k++) {
+    if ((err = s_mp_ctx_exptmod2 (G1, T1, &X1[k], G2, T2, &X2[k], c, &Y[k])) != MP_OKAY) {
       return err;
     }
   }
+  return MP_OKAY;
+}
 
-  /* create mu, used for Barrett reduction */
-  if ((err = mp_init (&mu)) != MP_OKAY) {
-    goto LBL_M;
-  }
-  
-  if (redmode == 0) {
-     if ((err = mp_reduce_setup (&mu, P)) != MP_OKAY) {
-        goto LBL_MU;
-     }
-     redux = mp_reduce;
-  } else {
-     if ((err = mp_reduce_2k_setup_l (P, &mu)) != MP_OKAY) {
-        goto LBL_MU;
-     }
-     redux = mp_reduce_2k_l;
-  }    
+int fast_mp_montgomery_reduce (mp_int * x, mp_int * n, mp_digit rho)
+{
+  int     ix, res, olduse;
+  mp_word W[MP_WARRAY];
 
-  /* create M table
-   *
-   * The M table contains powers of the base, 
-   * e.g. M[x] = G**x mod P
-   *
-   * The first half of the table is not 
-   * computed though accept for M[0] and M[1]
-   */
-  if ((err = mp_mod (G, P, &M[1])) != MP_OKAY) {
-    goto LBL_MU;
+  /* get old used count */
+  olduse = x->used;
+
+  /* grow a as required */
+  if (x->alloc < n->used + 1) {
+    if ((res = mp_grow (x, n->used + 1)) != MP_OKAY) {
+      return res;
+    }
   }
 
-  /* compute the value at M[1<<(winsize-1)] by squaring 
-   * M[1] (winsize-1) times 
+  /* first we have to get the digits of the input into
+   * an array of double precision words W[...]
    */
-  if ((err = mp_copy (&M[1], &M[1 << (winsize - 1)])) != MP_OKAY) {
-    goto LBL_MU;
-  }
+  {
+    register mp_word *_W;
+    register mp_digit *tmpx;
 
-  for (x = 0; x < (winsize - 1); x++) {
-    /* square it */
-    if ((err = mp_sqr (&M[1 << (winsize - 1)], 
-                       &M[1 << (winsize - 1)])) != MP_OKAY) {
-      goto LBL_MU;
+    /* alias for the W[] array */
+    _W   = W;
+
+    /* alias for the digits of  x*/
+    tmpx = x->dp;
+
+    /* copy the digits of a into W[0..a->used-1] */
+    for (ix = 0; ix < x->used; ix++) {
+      *_W++ = *tmpx++;
     }
 
-    /* reduce modulo P */
-    if ((err = redux (&M[1 << (winsize - 1)], P, &mu)) != MP_OKAY) {
-      goto LBL_MU;
+    /* zero the high words of W[a->used..m->used*2] */
+    for (; ix < n->used * 2 + 1; ix++) {
+      *_W++ = 0;
     }
   }
 
-  /* create upper table, that is M[x] = M[x-1] * M[1] (mod P)
-   * for x = (2**(winsize - 1) + 1) to (2**winsize - 1)
+  /* now we proceed to zero successive digits
+   * from the least significant upwards
    */
-  for (x = (1 << (winsize - 1)) + 1; x < (1 << winsize); x++) {
-    if ((err = mp_mul (&M[x - 1], &M[1], &M[x])) != MP_OKAY) {
-      goto LBL_MU;
-    }
-    if ((err = redux (&M[x], P, &mu)) != MP_OKAY) {
-      goto LBL_MU;
-    }
-  }
+  for (ix = 0; ix < n->used; ix++) {
+    /* mu = ai * m' mod b
+     *
+     * We avoid a double precision multiplication (which isn't required)
+     * by casting the value down to a mp_digit.  Note this requires
+     * that W[ix-1] have  the carry cleared (see after the inner loop)
+     */
+    register mp_digit mu;
+    mu = (mp_digit) (((W[ix] & MP_MASK) * rho) & MP_MASK);
 
-  /* setup result */
-  if ((err = mp_init (&res)) != MP_OKAY) {
-    goto LBL_MU;
-  }
-  mp_set (&res, 1);
+    /* a = a + mu * m * b**i
+     *
+     * This is computed in place and on the fly.  The multiplication
+     * by b**i is handled by offseting which columns the results
+     * are added to.
+     *
+     * Note the comba method normally doesn't handle carries in the
+     * inner loop In this case we fix the carry from the previous
+     * column since the Montgomery reduction requires digits of the
+     * result (so far) [see above] to work.  This is
+     * handled by fixing up one carry after the inner loop.  The
+     * carry fixups are done in order so after these loops the
+     * first m->used words of W[] have the carries fixed
+     */
+    {
+      register int iy;
+      register mp_digit *tmpn;
+      register mp_word *_W;
 
-  /* set initial mode and bit cnt */
-  mode   = 0;
-  bitcnt = 1;
-  buf    = 0;
-  digidx = X->used - 1;
-  bitcpy = 0;
-  bitbuf = 0;
+      /* alias for the digits of the modulus */
+      tmpn = n->dp;
 
-  for (;;) {
-    /* grab next digit as required */
-    if (--bitcnt == 0) {
-      /* if digidx == -1 we are out of digits */
-      if (digidx == -1) {
-        break;
+      /* Alias for the columns set by an offset of ix */
+      _W = W + ix;
+
+      /* inner loop */
+      for (iy = 0; iy < n->used; iy++) {
+          *_W++ += ((mp_word)mu) * ((mp_word)*tmpn++);
       }
-      /* read next digit and reset the bitcnt */
-      buf    = X->dp[digidx--];
-      bitcnt = (int) DIGIT_BIT;
     }
 
-    /* grab the next msb from the exponent */
-    y     = (buf >> (mp_digit)(DIGIT_BIT - 1)) & 1;
-    buf <<= (mp_digit)1;
+    /* now fix carry for next digit, W[ix+1] */
+    W[ix + 1] += W[ix] >> ((mp_word) DIGIT_BIT);
+  }
 
-    /* if the bit is zero and mode == 0 then we ignore it
-     * These represent the leading zero bits before the first 1 bit
-     * in the exponent.  Technically this opt is not required but it
-     * does lower the # of trivial squaring/reductions used
-     */
-    if (mode == 0 && y == 0) {
-      continue;
-    }
+  /* now we have to propagate the carries and
+   * shift the words downward [all those least
+   * significant digits we zeroed].
+   */
+  {
+    register mp_digit *tmpx;
+    register mp_word *_W, *_W1;
 
-    /* if the bit is zero and mode == 1 then we square */
-    if (mode == 1 && y == 0) {
-      if ((err = mp_sqr (&res, &res)) != MP_OKAY) {
-        goto LBL_RES;
-      }
-      if ((err = redux (&res, P, &mu)) != MP_OKAY) {
-        goto LBL_RES;
-      }
-      continue;
+    /* nox fix rest of carries */
+
+    /* alias for current word */
+    _W1 = W + ix;
+
+    /* alias for next word, where the carry goes */
+    _W = W + ++ix;
+
+    for (; ix <= n->used * 2 + 1; ix++) {
+      *_W++ += *_W1++ >> ((mp_word) DIGIT_BIT);
     }
 
-    /* else we add it to the window */
-    bitbuf |= (y << (winsize - ++bitcpy));
-    mode    = 2;
+    /* copy out, A = A/b**n
+     *
+     * The result is A/b**n but instead of converting from an
+     * array of mp_word to mp_digit than calling mp_rshd
+     * we just copy them in the right order
+     */
 
-    if (bitcpy == winsize) {
-      /* ok window is filled so square as required and multiply  */
-      /* square first */
-      for (x = 0; x < winsize; x++) {
-        if ((err = mp_sqr (&res, &res)) != MP_OKAY) {
-          goto LBL_RES;
-        }
-        if ((err = redux (&res, P, &mu)) != MP_OKAY) {
-          goto LBL_RES;
-        }
-      }
+    /* alias for destination word */
+    tmpx = x->dp;
 
-      /* then multiply */
-      if ((err = mp_mul (&res, &M[bitbuf], &res)) != MP_OKAY) {
-        goto LBL_RES;
-      }
-      if ((err = redux (&res, P, &mu)) != MP_OKAY) {
-        goto LBL_RES;
-      }
+    /* alias for shifted double precision result */
+    _W = W + n->used;
 
-      /* empty window and reset */
-      bitcpy = 0;
-      bitbuf = 0;
-      mode   = 1;
+    for (ix = 0; ix < n->used + 1; ix++) {
+      *tmpx++ = (mp_digit)(*_W++ & ((mp_word) MP_MASK));
+    }
+
+    /* zero oldused digits, if the input a was larger than
+     * m->used+1 we'll have to clear the digits
+     */
+    for (; ix < olduse; ix++) {
+      *tmpx++ = 0;
     }
   }
 
-  /* if bits remain then square/multiply */
-  if (mode == 2 && bitcpy > 0) {
-    /* square then multiply if the bit is set */
-    for (x = 0; x < bitcpy; x++) {
-      if ((err = mp_sqr (&res, &res)) != MP_OKAY) {
-        goto LBL_RES;
-      }
-      if ((err = redux (&res, P, &mu)) != MP_OKAY) {
-        goto LBL_RES;
-      }
+  /* set the max used and clamp */
+  x->used = n->used + 1;
+  mp_clamp (x);
 
-      bitbuf <<= 1;
-      if ((bitbuf & (1 << winsize)) != 0) {
-        /* then multiply */
-        if ((err = mp_mul (&res, &M[1], &res)) != MP_OKAY) {
-          goto LBL_RES;
-        }
-        if ((err = redux (&res, P, &mu)) != MP_OKAY) {
-          goto LBL_RES;
-        }
-      }
-    }
+  /* if A >= m then A = A - m */
+  if (mp_cmp_mag (x, n) != MP_LT) {
+    return s_mp_sub (x, n, x);
   }
+  return MP_OKAY;
+}
 
-  mp_exch (&res, Y);
-  err = MP_OKAY;
-LBL_RES:mp_clear (&res);
-LBL_MU:mp_clear (&mu);
-LBL_M:
-  mp_clear(&M[1]);
-  for (x = 1<<(winsize-1); x < (1 << winsize); x++) {
-    mp_clear (&M[x]);
+int mp_exptmod_fast (mp_int * G, mp_int * X, mp_int * P, mp_int * Y, int redmode)
+{
+  mp_mod_ctx ctx;
+  int        err;
+
+  /* redmode 0, 1, 2, 5 and 6 map directly onto MP_REDUCE_MONT, _DR, _2K, _MONT_FUSED and _MONT_R64 */
+  if ((err = s_mp_mod_ctx_setup (&ctx, P, redmode)) != MP_OKAY) {
+    return err;
+  }
+
+  err = mp_exptmod_ctx (G, X, &ctx, Y);
+  mp_mod_ctx_clear (&ctx);
+  return err;
+}
+
+int s_mp_exptmod (mp_int * G, mp_int * X, mp_int * P, mp_int * Y, int redmode)
+{
+  mp_mod_ctx ctx;
+  int        err;
+
+  if ((err = s_mp_mod_ctx_setup (&ctx, P, (redmode == 0) ? MP_REDUCE_BARRETT : MP_REDUCE_2K_L)) != MP_OKAY) {
+    return err;
   }
+
+  err = mp_exptmod_ctx (G, X, &ctx, Y);
+  mp_mod_ctx_clear (&ctx);
   return err;
 }
 
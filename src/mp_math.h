@@ -33,9 +33,12 @@
 	#define  OPT_CAST(x)
 #endif
 
-/* detect 64-bit mode if possible */
-#if defined(__x86_64__)
-   #if !(defined(MP_64BIT) && defined(MP_16BIT) && defined(MP_8BIT))
+/* detect 64-bit mode if possible: any GCC/Clang target with a 64-bit long
+ * and a 128-bit integer type can hold the mp_word of 60-bit digits.
+ * Define MP_8BIT, MP_16BIT or MP_28BIT to force smaller digits instead.
+ */
+#if defined(__SIZEOF_INT128__) && defined(__SIZEOF_LONG__) && __SIZEOF_LONG__ == 8
+   #if !(defined(MP_64BIT) || defined(MP_28BIT) || defined(MP_16BIT) || defined(MP_8BIT))
       #define MP_64BIT
    #endif
 #endif
@@ -79,7 +82,9 @@
    typedef ulong64            mp_word;
 
    #define DIGIT_BIT          28
-   #define MP_28BIT
+   #ifndef MP_28BIT
+      #define MP_28BIT
+   #endif
 #endif
 
 #ifndef DIGIT_BIT
@@ -118,12 +123,94 @@ typedef int mp_err;
 /* size of comba arrays, should be at least 2 * 2**(BITS_PER_WORD - BITS_PER_DIGIT*2) */
 #define MP_WARRAY               (1 << (sizeof(mp_word) * CHAR_BIT - 2 * DIGIT_BIT + 1))
 
+/* limit on the digits of a modulus for mp_montgomery_mul_fused() */
+#define MP_FUSED_DIGITS         (1 << (sizeof(mp_word) * CHAR_BIT - 2 * DIGIT_BIT - 1))
+
+/* limb size of the MP_REDUCE_MONT_R64 representation */
+#define MP_R64_BIT              64
+
+/* limb size of the MP_REDUCE_MONT_R52 representation, and the limit on
+ * the limbs of its modulus (a multiple of 8, the 64-bit lanes of a zmm) */
+#define MP_R52_BIT              52
+#define MP_R52_LIMBS            128
+
+/* smallest modulus, in bits, for which the IFMA engine beats the scalar kernels */
+#define MP_R52_MIN_BITS         2048
+
+/* values the IFMA engine works on at once in s_mp_ctx_exptmod2_lanes(),
+ * one per 64-bit lane of a zmm */
+#define MP_R52_LANES            8
+
+/* mulx/adcx/adox kernels for MP_REDUCE_MONT_R64 and the AVX-512 IFMA engine
+ * of MP_REDUCE_MONT_R52, used when the CPU has them */
+#if defined(MP_64BIT) && defined(__x86_64__) && defined(__GNUC__)
+   #define MP_HAVE_ADX
+   #define MP_HAVE_IFMA
+#endif
+
+/* kernel flags, see mp_cpu_kernel() */
+#define MP_KERNEL_C        0   /* portable C */
+#define MP_KERNEL_ADX      1   /* BMI2 + ADX, x86-64 */
+#define MP_KERNEL_IFMA     2   /* AVX-512F + AVX-512 IFMA, x86-64 */
+
+/* Karatsuba cutoffs, in digits, see bench/tune.c */
+extern int KARATSUBA_MUL_CUTOFF,
+           KARATSUBA_SQR_CUTOFF;
+
 /* the infamous mp_int structure */
 typedef struct  {
     int used, alloc, sign;
     mp_digit *dp;
 } mp_int;
 
+/* reduction methods used by a mp_mod_ctx */
+#define MP_REDUCE_MONT     0   /* Montgomery, odd moduli */
+#define MP_REDUCE_DR       1   /* diminished radix, moduli of the form B**k - b */
+#define MP_REDUCE_2K       2   /* unrestricted diminished radix, 2**k - b */
+#define MP_REDUCE_BARRETT  3   /* Barrett, any modulus */
+#define MP_REDUCE_2K_L     4   /* 2**k - d with a multi-digit d */
+#define MP_REDUCE_MONT_FUSED 5 /* Montgomery with fused multiply and reduce, odd moduli */
+#define MP_REDUCE_MONT_R64 6   /* Montgomery on full 64-bit limbs, odd moduli, MP_64BIT only */
+#define MP_REDUCE_MONT_R52 7   /* Montgomery on 52-bit limbs with AVX-512 IFMA, odd moduli */
+
+/* methods that keep values in Montgomery form */
+#define MP_REDUCE_IS_MONT(m) ((m) == MP_REDUCE_MONT || (m) == MP_REDUCE_MONT_FUSED || \
+                              (m) == MP_REDUCE_MONT_R64 || (m) == MP_REDUCE_MONT_R52)
+
+/* precomputed state for repeated arithmetic modulo a fixed P.
+ *
+ * Values handled by the s_mp_ctx_*() functions live in the context's own
+ * representation (Montgomery form for MP_REDUCE_IS_MONT(), plain residues
+ * otherwise, and 64 or 52-bit limbs rather than DIGIT_BIT digits for
+ * MP_REDUCE_MONT_R64 and _R52) and are converted with s_mp_ctx_enter() and
+ * s_mp_ctx_leave(). Chaining s_mp_ctx_*() calls keeps intermediate results in that
+ * representation, so they are converted once at the very end.
+ */
+typedef struct {
+    mp_int   P;      /* the modulus */
+    int      mode;   /* one of MP_REDUCE_* */
+    mp_digit rho;    /* Montgomery rho, or the DR/2k constant */
+    mp_int   mu;     /* Barrett mu, or the 2k_l constant */
+    mp_int   R;      /* representation of 1 (R mod P for Montgomery) */
+    mp_int   RR;     /* R**2 mod P for Montgomery, 1 otherwise */
+    mp_int   N;      /* P in the limbs of MP_REDUCE_MONT_R64 and _R52 */
+    int      kernel; /* MP_KERNEL_* flags usable with this context */
+} mp_mod_ctx;
+
+/* fixed-base comb table, G**X for any X of up to teeth*spacing bits
+ * costs spacing-1 squarings and at most spacing multiplications.
+ *
+ * T[i] = prod G**(2**(j*spacing)) over every bit j set in i, stored in the
+ * representation of the mp_mod_ctx used to build it.
+ */
+#define MP_COMB_MAX_TEETH  16
+
+typedef struct {
+    int     teeth;    /* bits per column, the table has 2**teeth entries */
+    int     spacing;  /* distance in bits between two teeth */
+    mp_int *T;
+} mp_comb;
+
 /* callback for mp_prime_random, should fill dst with random bytes and return how many read [upto len] */
 typedef int ltm_prime_callback(unsigned char *dst, int len, void *dat);
 
@@ -142,6 +229,7 @@ void mp_clear_multi(mp_int *mp, ...);
 void mp_exch(mp_int *a, mp_int *b);
 int mp_grow(mp_int *a, int size);
 int mp_init_size(mp_int *a, int size);
+int mp_shrink(mp_int *a);
 // }}}
 
 // Basic Manipulations {{{
@@ -206,11 +294,26 @@ int mp_reduce_is_2k_l(mp_int *a);
 int mp_reduce_2k_setup_l(mp_int *a, mp_int *d);
 int mp_reduce_2k_l(mp_int *a, mp_int *n, mp_int *d);
 int mp_exptmod(mp_int *a, mp_int *b, mp_int *c, mp_int *d);
+int mp_exptmod2(mp_int *G1, mp_int *X1, mp_int *G2, mp_int *X2, mp_int *P, mp_int *Y);
+// }}}
+
+// Modulus context {{{
+int mp_mod_ctx_init(mp_mod_ctx *c, mp_int *P);
+void mp_mod_ctx_clear(mp_mod_ctx *c);
+int mp_mulmod_ctx(mp_int *a, mp_int *b, mp_mod_ctx *c, mp_int *d);
+int mp_exptmod_ctx(mp_int *G, mp_int *X, mp_mod_ctx *c, mp_int *Y);
+int mp_comb_init(mp_comb *T, mp_int *G, int bits, int teeth, mp_mod_ctx *c);
+void mp_comb_clear(mp_comb *T);
+size_t mp_comb_size(int teeth, mp_mod_ctx *c);
+int mp_exptmod_comb(mp_comb *T, mp_int *X, mp_mod_ctx *c, mp_int *Y);
+int mp_exptmod2_ctx(mp_int *G1, mp_comb *T1, mp_int *X1, mp_int *G2, mp_comb *T2, mp_int *X2, mp_mod_ctx *c, mp_int *Y);
 // }}}
 
 // Radix conversion {{{
 int mp_count_bits(mp_int *a);
 int mp_read_unsigned_bin(mp_int *a, const unsigned char *b, int c);
+int mp_unsigned_bin_size(mp_int *a);
+int mp_to_unsigned_bin(mp_int *a, unsigned char *b);
 int mp_read_radix(mp_int *a, const char *str, int radix);
 int mp_toradix(mp_int *a, char *str, int radix);
 #define mp_tobinary(M, S)  mp_toradix((M), (S), 2)
@@ -226,10 +329,37 @@ int s_mp_sub(mp_int *a, mp_int *b, mp_int *c);
 int fast_s_mp_mul_digs(mp_int *a, mp_int *b, mp_int *c, int digs);
 int s_mp_mul_digs(mp_int *a, mp_int *b, mp_int *c, int digs);
 int s_mp_mul_high_digs(mp_int *a, mp_int *b, mp_int *c, int digs);
+int fast_s_mp_sqr(mp_int *a, mp_int *b);
+int mp_karatsuba_mul(mp_int *a, mp_int *b, mp_int *c);
+int mp_karatsuba_sqr(mp_int *a, mp_int *b);
 int s_mp_sqr(mp_int *a, mp_int *b);
 int fast_mp_montgomery_reduce(mp_int *a, mp_int *m, mp_digit mp);
+int mp_montgomery_mul_fused(mp_int *a, mp_int *b, mp_int *n, mp_digit rho, mp_int *c);
+int mp_montgomery_sqr_fused(mp_int *a, mp_int *n, mp_digit rho, mp_int *b);
+int s_mp_pack_limbs(mp_int *a, int bits, mp_int *b);
+int s_mp_unpack_limbs(mp_int *a, int bits, mp_int *b);
+int mp_montgomery_setup_r64(mp_int *n, mp_digit *rho);
+int mp_montgomery_mul_r64(mp_int *a, mp_int *b, mp_int *n, mp_digit rho, mp_int *c);
+int mp_montgomery_sqr_r64(mp_int *a, mp_int *n, mp_digit rho, mp_int *b);
+int mp_montgomery_reduce_r64(mp_int *x, mp_int *n, mp_digit rho);
+int mp_montgomery_mul_r64_adx(mp_int *a, mp_int *b, mp_int *n, mp_digit rho, mp_int *c);
+int mp_montgomery_sqr_r64_adx(mp_int *a, mp_int *n, mp_digit rho, mp_int *b);
+int mp_montgomery_mul_r52_ifma(mp_int *a, mp_int *b, mp_int *n, mp_digit rho, mp_int *c);
+int mp_montgomery_sqr_r52_ifma(mp_int *a, mp_int *n, mp_digit rho, mp_int *b);
+int mp_montgomery_reduce_r52_ifma(mp_int *x, mp_int *n, mp_digit rho);
+int mp_cpu_kernel(void);
 int mp_exptmod_fast(mp_int *G, mp_int *X, mp_int *P, mp_int *Y, int mode);
 int s_mp_exptmod (mp_int * G, mp_int * X, mp_int * P, mp_int * Y, int mode);
+int s_mp_mont_mode(mp_int *P);
+int s_mp_mod_ctx_setup(mp_mod_ctx *c, mp_int *P, int mode);
+int s_mp_ctx_reduce(mp_int *a, mp_mod_ctx *c);
+int s_mp_ctx_mul(mp_int *a, mp_int *b, mp_mod_ctx *c, mp_int *d);
+int s_mp_ctx_sqr(mp_int *a, mp_mod_ctx *c, mp_int *b);
+int s_mp_ctx_enter(mp_int *a, mp_mod_ctx *c, mp_int *b);
+int s_mp_ctx_leave(mp_int *a, mp_mod_ctx *c, mp_int *b);
+int s_mp_ctx_exptmod(mp_int *G, mp_int *X, mp_mod_ctx *c, mp_int *Y);
+int s_mp_ctx_exptmod2(mp_int *G1, mp_comb *T1, mp_int *X1, mp_int *G2, mp_comb *T2, mp_int *X2, mp_mod_ctx *c, mp_int *Y);
+int s_mp_ctx_exptmod2_lanes(mp_int *G1, mp_comb *T1, mp_int *X1, mp_int *G2, mp_comb *T2, mp_int *X2, int n, mp_mod_ctx *c, mp_int *Y);
 void bn_reverse(unsigned char *s, int len);
 // }}}
 
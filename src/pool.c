@@ -0,0 +1,357 @@
+/*
+ *  This file is part of the dsa-verify library (https://github.com/marcizhu/dsa-verify)
+ *
+ *  Copyright (C) 2021 Marc Izquierdo
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#include <stdlib.h>
+
+#include "pool.h"
+
+#ifdef _WIN32
+#include <windows.h>
+
+typedef HANDLE thread_t;
+typedef CRITICAL_SECTION mutex_t;
+typedef CONDITION_VARIABLE cond_t;
+
+#define mutex_init(m)     (InitializeCriticalSection(m), 0)
+#define mutex_destroy(m)  DeleteCriticalSection(m)
+#define mutex_lock(m)     EnterCriticalSection(m)
+#define mutex_unlock(m)   LeaveCriticalSection(m)
+#define cond_init(c)      (InitializeConditionVariable(c), 0)
+#define cond_destroy(c)   ((void)(c))
+#define cond_wait(c, m)   SleepConditionVariableCS(c, m, INFINITE)
+#define cond_broadcast(c) WakeAllConditionVariable(c)
+#else
+#include <pthread.h>
+#include <unistd.h>
+
+typedef pthread_t thread_t;
+typedef pthread_mutex_t mutex_t;
+typedef pthread_cond_t cond_t;
+
+#define mutex_init(m)     pthread_mutex_init(m, NULL)
+#define mutex_destroy(m)  pthread_mutex_destroy(m)
+#define mutex_lock(m)     pthread_mutex_lock(m)
+#define mutex_unlock(m)   pthread_mutex_unlock(m)
+#define cond_init(c)      pthread_cond_init(c, NULL)
+#define cond_destroy(c)   pthread_cond_destroy(c)
+#define cond_wait(c, m)   pthread_cond_wait(c, m)
+#define cond_broadcast(c) pthread_cond_broadcast(c)
+#endif
+
+typedef struct
+{
+	dsa_pool* pool;
+	thread_t thread;
+	mutex_t lock;     ///< Protects `next` and `end`
+	size_t next, end; ///< Items of the current job still waiting for this thread
+} pool_worker;
+
+struct dsa_pool
+{
+	unsigned int threads; ///< Number of threads, including the one calling @ref pool_run()
+	pool_worker* workers; ///< One per thread, the first one belongs to the caller
+	mutex_t lock;         ///< Protects everything below
+	cond_t work, done;
+	unsigned long job;    ///< Bumped for every new job
+	unsigned int busy;    ///< Helper threads still working on the current job
+	int quit;
+	pool_fn fn;
+	void* arg;
+};
+
+// Takes the upper half of the items left to another thread, returns 0 if there are none
+static int _pool_steal(pool_worker* w)
+{
+	dsa_pool* pool = w->pool;
+	unsigned int id = (unsigned int)(w - pool->workers);
+
+	for (unsigned int k = 1; k < pool->threads; k++)
+	{
+		pool_worker* v = &pool->workers[(id + k) % pool->threads];
+		size_t begin = 0, end = 0;
+
+		mutex_lock(&v->lock);
+
+		if (v->next < v->end)
+		{
+			begin = v->end - (v->end - v->next + 1) / 2;
+			end = v->end;
+			v->end = begin;
+		}
+
+		mutex_unlock(&v->lock);
+
+		if (begin != end)
+		{
+			mutex_lock(&w->lock);
+			w->next = begin;
+			w->end = end;
+			mutex_unlock(&w->lock);
+
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+static void _pool_work(pool_worker* w)
+{
+	dsa_pool* pool = w->pool;
+
+	for (;;)
+	{
+		size_t i = 0;
+		int found;
+
+		mutex_lock(&w->lock);
+
+		if ((found = (w->next < w->end)) != 0)
+			i = w->next++;
+
+		mutex_unlock(&w->lock);
+
+		if (found)
+			pool->fn(pool->arg, i);
+		else if (_pool_steal(w) == 0)
+			return;
+	}
+}
+
+static void _pool_main(pool_worker* w)
+{
+	dsa_pool* pool = w->pool;
+	unsigned long job = 0;
+
+	for (;;)
+	{
+		mutex_lock(&pool->lock);
+
+		while (pool->quit == 0 && pool->job == job)
+			cond_wait(&pool->work, &pool->lock);
+
+		int quit = pool->quit;
+		job = pool->job;
+
+		mutex_unlock(&pool->lock);
+
+		if (quit)
+			return;
+
+		_pool_work(w);
+
+		mutex_lock(&pool->lock);
+
+		if (--pool->busy == 0)
+			cond_broadcast(&pool->done);
+
+		mutex_unlock(&pool->lock);
+	}
+}
+
+#ifdef _WIN32
+static DWORD WINAPI _pool_thread(LPVOID arg)
+{
+	_pool_main((pool_worker*)arg);
+	return 0;
+}
+
+static int _pool_thread_start(pool_worker* w)
+{
+	return (w->thread = CreateThread(NULL, 0, _pool_thread, w, 0, NULL)) == NULL;
+}
+
+static void _pool_thread_join(pool_worker* w)
+{
+	WaitForSingleObject(w->thread, INFINITE);
+	CloseHandle(w->thread);
+}
+
+static unsigned int _pool_cpu_count(void)
+{
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+
+	return (unsigned int)info.dwNumberOfProcessors;
+}
+#else
+static void* _pool_thread(void* arg)
+{
+	_pool_main((pool_worker*)arg);
+	return NULL;
+}
+
+static int _pool_thread_start(pool_worker* w)
+{
+	return pthread_create(&w->thread, NULL, _pool_thread, w);
+}
+
+static void _pool_thread_join(pool_worker* w)
+{
+	pthread_join(w->thread, NULL);
+}
+
+static unsigned int _pool_cpu_count(void)
+{
+#ifdef _SC_NPROCESSORS_ONLN
+	long count = sysconf(_SC_NPROCESSORS_ONLN);
+
+	if (count > 0)
+		return (unsigned int)count;
+#endif
+
+	return 1;
+}
+#endif
+
+// Stops and frees a pool whose first `started` helper threads are running
+static void _pool_destroy(dsa_pool* pool, unsigned int locks, unsigned int started)
+{
+	mutex_lock(&pool->lock);
+	pool->quit = 1;
+	cond_broadcast(&pool->work);
+	mutex_unlock(&pool->lock);
+
+	for (unsigned int i = 1; i <= started; i++)
+		_pool_thread_join(&pool->workers[i]);
+
+	for (unsigned int i = 0; i < locks; i++)
+		mutex_destroy(&pool->workers[i].lock);
+
+	cond_destroy(&pool->done);
+	cond_destroy(&pool->work);
+	mutex_destroy(&pool->lock);
+	free(pool->workers);
+	free(pool);
+}
+
+int dsa_pool_create(unsigned int threads, dsa_pool** pool)
+{
+	if (threads == 0)
+		threads = _pool_cpu_count();
+
+	dsa_pool* p = malloc(sizeof(dsa_pool));
+
+	if (p == NULL)
+		return DSA_GENERIC_ERROR;
+
+	if ((p->workers = calloc(threads, sizeof(pool_worker))) == NULL || mutex_init(&p->lock) != 0)
+	{
+		free(p->workers);
+		free(p);
+		return DSA_GENERIC_ERROR;
+	}
+
+	if (cond_init(&p->work) != 0)
+	{
+		mutex_destroy(&p->lock);
+		free(p->workers);
+		free(p);
+		return DSA_GENERIC_ERROR;
+	}
+
+	if (cond_init(&p->done) != 0)
+	{
+		cond_destroy(&p->work);
+		mutex_destroy(&p->lock);
+		free(p->workers);
+		free(p);
+		return DSA_GENERIC_ERROR;
+	}
+
+	p->threads = threads;
+	p->job = 0;
+	p->busy = 0;
+	p->quit = 0;
+
+	unsigned int i;
+
+	for (i = 0; i < threads; i++)
+	{
+		p->workers[i].pool = p;
+
+		if (mutex_init(&p->workers[i].lock) != 0)
+		{
+			_pool_destroy(p, i, 0);
+			return DSA_GENERIC_ERROR;
+		}
+	}
+
+	// The first worker is the thread calling pool_run(), so it needs no thread of its own
+	for (i = 1; i < threads; i++)
+	{
+		if (_pool_thread_start(&p->workers[i]) != 0)
+		{
+			_pool_destroy(p, threads, i - 1);
+			return DSA_GENERIC_ERROR;
+		}
+	}
+
+	*pool = p;
+
+	return DSA_VERIFICATION_OK;
+}
+
+void dsa_pool_free(dsa_pool* pool)
+{
+	if (pool == NULL)
+		return;
+
+	_pool_destroy(pool, pool->threads, pool->threads - 1);
+}
+
+void pool_run(dsa_pool* pool, size_t count, pool_fn fn, void* arg)
+{
+	size_t share = count / pool->threads, extra = count % pool->threads, next = 0;
+
+	if (count == 0)
+		return;
+
+	pool->fn = fn;
+	pool->arg = arg;
+
+	// Deal out contiguous ranges, the workers are idle so no locking is needed
+	for (unsigned int i = 0; i < pool->threads; i++)
+	{
+		pool->workers[i].next = next;
+		next += share + (i < extra ? 1 : 0);
+		pool->workers[i].end = next;
+	}
+
+	mutex_lock(&pool->lock);
+	pool->busy = pool->threads - 1;
+	pool->job++;
+	cond_broadcast(&pool->work);
+	mutex_unlock(&pool->lock);
+
+	_pool_work(&pool->workers[0]);
+
+	mutex_lock(&pool->lock);
+
+	while (pool->busy > 0)
+		cond_wait(&pool->done, &pool->lock);
+
+	mutex_unlock(&pool->lock);
+}
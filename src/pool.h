@@ -0,0 +1,54 @@
+/*
+ *  This file is part of the dsa-verify library (https://github.com/marcizhu/dsa-verify)
+ *
+ *  Copyright (C) 2021 Marc Izquierdo
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#ifndef _POOL_H_
+#define _POOL_H_
+
+#include <stddef.h>
+
+#include "dsa-verify.h"
+
+/** @brief Work done by the pool for every item of a job */
+typedef void (*pool_fn)(void* arg, size_t index);
+
+/**
+ * @brief Run a job on a pool of threads
+ *
+ * Calls `fn(arg, i)` once for every `i` in `[0, count)`, spread over all the
+ * threads of the pool, including the calling one. Items are dealt out in
+ * contiguous ranges, one per thread, and threads that run out of work steal
+ * half of the remaining range of another one. Returns once every item has
+ * been processed.
+ *
+ * Only one job may run on a pool at any given time.
+ *
+ * @param[in] pool   Pool of threads to run the job on
+ * @param[in] count  Number of items of the job
+ * @param[in] fn     Function called for every item
+ * @param[in] arg    Argument passed untouched to `fn`
+ */
+void pool_run(dsa_pool* pool, size_t count, pool_fn fn, void* arg);
+
+#endif
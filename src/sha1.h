@@ -83,6 +83,72 @@ void SHA1_result(SHA1_CTX* context, SHA1_t digest);
  */
 void SHA1(SHA1_t digest, const unsigned char* data, size_t len);
 
+/**
+ * @brief Run the SHA1 compression function over whole blocks
+ *
+ * Updates `state` with `blocks` consecutive 64-byte blocks of `data`. This is
+ * where @ref SHA1_input() spends its time, so it picks the fastest back end
+ * the CPU supports: the SHA extensions, then SSSE3, then portable C.
+ *
+ * @param[in,out] state   Chaining state, as in @ref SHA1_CTX
+ * @param[in]     data    Input blocks
+ * @param[in]     blocks  Number of 64-byte blocks in `data`
+ */
+void SHA1_blocks(uint32_t state[5], const unsigned char* data, size_t blocks);
+
+/**
+ * @brief Calculate the SHA1 of many independent messages
+ *
+ * Gives the same hashes as calling @ref SHA1() once per message, but on CPUs
+ * with AVX2 or AVX-512 the messages are hashed side by side, one per 32-bit
+ * lane of the vector unit. A lane that is done with its message moves on to
+ * the next one, so the messages need not be the same length.
+ *
+ * @param[out] digests  Array of `count` hashes
+ * @param[in]  data     Array of `count` messages
+ * @param[in]  lens     Length of each message, in bytes
+ * @param[in]  count    Number of messages
+ */
+void SHA1_multi(SHA1_t* digests, const unsigned char* const* data, const size_t* lens, size_t count);
+
+/** @brief Portable C back end of @ref SHA1_blocks() */
+void SHA1_blocks_generic(uint32_t state[5], const unsigned char* data, size_t blocks);
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define SHA1_HAVE_X86
+
+/**
+ * @brief SSSE3 back end of @ref SHA1_blocks()
+ *
+ * Computes the message schedule four words at a time, the rounds stay scalar.
+ * The CPU must support SSSE3.
+ */
+void SHA1_blocks_ssse3(uint32_t state[5], const unsigned char* data, size_t blocks);
+
+/**
+ * @brief SHA extensions back end of @ref SHA1_blocks()
+ *
+ * Runs four rounds per `sha1rnds4`, with the schedule from `sha1msg1` and
+ * `sha1msg2`. The CPU must support SHA and SSE4.1.
+ */
+void SHA1_blocks_shani(uint32_t state[5], const unsigned char* data, size_t blocks);
+
+/**
+ * @brief AVX2 back end of @ref SHA1_multi()
+ *
+ * Compresses one block of each of 8 messages, where word `i` of the chaining
+ * state of lane `l` is `state[8 * i + l]`. The CPU must support AVX2.
+ */
+void SHA1_lanes_avx2(uint32_t state[40], const unsigned char* const blocks[8]);
+
+/**
+ * @brief AVX-512 back end of @ref SHA1_multi()
+ *
+ * Same as @ref SHA1_lanes_avx2(), on 16 lanes. The CPU must support AVX-512F.
+ */
+void SHA1_lanes_avx512(uint32_t state[80], const unsigned char* const blocks[16]);
+#endif
+
 #ifdef SHA1_IMPLEMENTATION
 /******************************************************************************
  *                               IMPLEMENTATION                               *
@@ -93,6 +159,10 @@ void SHA1(SHA1_t digest, const unsigned char* data, size_t len);
 
 #include "sha1.h"
 
+#ifdef SHA1_HAVE_X86
+#include <immintrin.h>
+#endif
+
 #define rol(value, bits) (((value) << (bits)) | ((value) >> (32 - (bits))))
 
 /* blk0() and blk() perform the initial expand. */
@@ -224,6 +294,268 @@ void SHA1_transform(uint32_t state[5], const unsigned char buffer[64])
 	state[4] += e;
 }
 
+void SHA1_blocks_generic(uint32_t state[5], const unsigned char* data, size_t blocks)
+{
+	for (; blocks > 0; blocks--, data += 64)
+		SHA1_transform(state, data);
+}
+
+#ifdef SHA1_HAVE_X86
+/* The rounds of SHA1_transform() with the schedule, K included, already in wk[] */
+#define S1(v,w,x,y,z,i) z+=((w&(x^y))^y)+wk[i]+rol(v,5);w=rol(w,30);
+#define S2(v,w,x,y,z,i) z+=(w^x^y)+wk[i]+rol(v,5);w=rol(w,30);
+#define S3(v,w,x,y,z,i) z+=(((w|x)&y)|(w&x))+wk[i]+rol(v,5);w=rol(w,30);
+#define S5(S,i) S(a,b,c,d,e,i) S(e,a,b,c,d,i+1) S(d,e,a,b,c,i+2) S(c,d,e,a,b,i+3) S(b,c,d,e,a,i+4)
+
+/* W[i] = rol(W[i-3] ^ W[i-8] ^ W[i-14] ^ W[i-16], 1) for i = 4t .. 4t+3, then plus K into
+   wk[]. The last lane needs W[i] of the first one, so it gets that term afterwards. */
+#define SHA1_ROL1(x) _mm_or_si128(_mm_slli_epi32(x, 1), _mm_srli_epi32(x, 31))
+#define SHA1_SCHED(t) { \
+	__m128i x = _mm_xor_si128(_mm_xor_si128(sched[t - 4], _mm_alignr_epi8(sched[t - 3], sched[t - 4], 8)), \
+	                          _mm_xor_si128(sched[t - 2], _mm_srli_si128(sched[t - 1], 4))); \
+	x = SHA1_ROL1(x); \
+	sched[t] = _mm_xor_si128(x, SHA1_ROL1(_mm_slli_si128(x, 12))); \
+	_mm_storeu_si128((__m128i*)(wk + 4 * t), _mm_add_epi32(sched[t], K[t / 5])); }
+
+__attribute__((target("ssse3")))
+void SHA1_blocks_ssse3(uint32_t state[5], const unsigned char* data, size_t blocks)
+{
+	const __m128i bswap = _mm_set_epi8(12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3);
+	const __m128i K[4] = {
+		_mm_set1_epi32(0x5A827999), _mm_set1_epi32(0x6ED9EBA1),
+		_mm_set1_epi32((int)0x8F1BBCDC), _mm_set1_epi32((int)0xCA62C1D6)
+	};
+
+	__m128i sched[20]; /* W[4t .. 4t+3] */
+	uint32_t wk[80];
+
+	for (; blocks > 0; blocks--, data += 64)
+	{
+		for (int t = 0; t < 4; t++)
+		{
+			sched[t] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + 16 * t)), bswap);
+			_mm_storeu_si128((__m128i*)(wk + 4 * t), _mm_add_epi32(sched[t], K[0]));
+		}
+
+		uint32_t a = state[0];
+		uint32_t b = state[1];
+		uint32_t c = state[2];
+		uint32_t d = state[3];
+		uint32_t e = state[4];
+
+		/* each group of 5 rounds overlaps with the schedule of 4 words ahead */
+		SHA1_SCHED( 4) S5(S1,  0) SHA1_SCHED( 5) S5(S1,  5) SHA1_SCHED( 6) S5(S1, 10) SHA1_SCHED( 7) S5(S1, 15)
+		SHA1_SCHED( 8) S5(S2, 20) SHA1_SCHED( 9) S5(S2, 25) SHA1_SCHED(10) S5(S2, 30) SHA1_SCHED(11) S5(S2, 35)
+		SHA1_SCHED(12) S5(S3, 40) SHA1_SCHED(13) S5(S3, 45) SHA1_SCHED(14) S5(S3, 50) SHA1_SCHED(15) S5(S3, 55)
+		SHA1_SCHED(16) S5(S2, 60) SHA1_SCHED(17) S5(S2, 65) SHA1_SCHED(18) S5(S2, 70) SHA1_SCHED(19) S5(S2, 75)
+
+		state[0] += a;
+		state[1] += b;
+		state[2] += c;
+		state[3] += d;
+		state[4] += e;
+	}
+}
+
+/* Rounds 4g .. 4g+3 on the SHA extensions, after the Intel reference code. m[g % 4]
+   holds the words of these rounds, and the schedule of the next ones is advanced
+   while they run: msg2 finishes m[g+1], msg1 and the xor start m[g+3] and m[g+2]. */
+#define SHA1_QUAD(g, e_in, e_out, m_prev2, m_prev, m_cur, m_next)       \
+	e_in = ((g) == 0 ? _mm_add_epi32(e_in, m_cur)                        \
+	                 : _mm_sha1nexte_epu32(e_in, m_cur));                \
+	e_out = abcd;                                                        \
+	if ((g) >= 3 && (g) <= 18) m_next = _mm_sha1msg2_epu32(m_next, m_cur); \
+	abcd = _mm_sha1rnds4_epu32(abcd, e_in, (g) / 5);                     \
+	if ((g) >= 1 && (g) <= 16) m_prev = _mm_sha1msg1_epu32(m_prev, m_cur); \
+	if ((g) >= 2 && (g) <= 17) m_prev2 = _mm_xor_si128(m_prev2, m_cur);
+
+__attribute__((target("sha,sse4.1")))
+void SHA1_blocks_shani(uint32_t state[5], const unsigned char* data, size_t blocks)
+{
+	const __m128i bswap = _mm_set_epi64x(0x0001020304050607LL, 0x08090A0B0C0D0E0FLL);
+
+	/* a is the highest word of abcd, e the highest of e0 */
+	__m128i abcd = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)state), 0x1B);
+	__m128i e0 = _mm_set_epi32((int)state[4], 0, 0, 0);
+	__m128i e1, m0, m1, m2, m3;
+
+	for (; blocks > 0; blocks--, data += 64)
+	{
+		__m128i abcd_save = abcd;
+		__m128i e0_save = e0;
+
+		m0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data +  0)), bswap);
+		m1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + 16)), bswap);
+		m2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + 32)), bswap);
+		m3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + 48)), bswap);
+
+		SHA1_QUAD( 0, e0, e1, m2, m3, m0, m1)
+		SHA1_QUAD( 1, e1, e0, m3, m0, m1, m2)
+		SHA1_QUAD( 2, e0, e1, m0, m1, m2, m3)
+		SHA1_QUAD( 3, e1, e0, m1, m2, m3, m0)
+		SHA1_QUAD( 4, e0, e1, m2, m3, m0, m1)
+		SHA1_QUAD( 5, e1, e0, m3, m0, m1, m2)
+		SHA1_QUAD( 6, e0, e1, m0, m1, m2, m3)
+		SHA1_QUAD( 7, e1, e0, m1, m2, m3, m0)
+		SHA1_QUAD( 8, e0, e1, m2, m3, m0, m1)
+		SHA1_QUAD( 9, e1, e0, m3, m0, m1, m2)
+		SHA1_QUAD(10, e0, e1, m0, m1, m2, m3)
+		SHA1_QUAD(11, e1, e0, m1, m2, m3, m0)
+		SHA1_QUAD(12, e0, e1, m2, m3, m0, m1)
+		SHA1_QUAD(13, e1, e0, m3, m0, m1, m2)
+		SHA1_QUAD(14, e0, e1, m0, m1, m2, m3)
+		SHA1_QUAD(15, e1, e0, m1, m2, m3, m0)
+		SHA1_QUAD(16, e0, e1, m2, m3, m0, m1)
+		SHA1_QUAD(17, e1, e0, m3, m0, m1, m2)
+		SHA1_QUAD(18, e0, e1, m0, m1, m2, m3)
+		SHA1_QUAD(19, e1, e0, m1, m2, m3, m0)
+
+		/* e0 holds the a of round 76, the e of the result once rotated */
+		e0 = _mm_sha1nexte_epu32(e0, e0_save);
+		abcd = _mm_add_epi32(abcd, abcd_save);
+	}
+
+	_mm_storeu_si128((__m128i*)state, _mm_shuffle_epi32(abcd, 0x1B));
+	state[4] = (uint32_t)_mm_extract_epi32(e0, 3);
+}
+
+/* Round t of SHA1_transform() on every lane, in terms of the SHA1_V_* operations of
+   the vector width at hand. m[] holds the last 16 words of the schedule. */
+#define SHA1_VR(F,k,v,w,x,y,z,t) \
+	if ((t) >= 16) m[(t) & 15] = SHA1_V_SCHED(m[((t) - 3) & 15], m[((t) - 8) & 15], m[((t) - 14) & 15], m[(t) & 15]); \
+	z = SHA1_V_ADD(SHA1_V_ADD(z, SHA1_V_ROL(v, 5)), SHA1_V_ADD(F(w, x, y), SHA1_V_ADD(m[(t) & 15], k))); \
+	w = SHA1_V_ROL(w, 30);
+#define SHA1_VR5(F,k,t) SHA1_VR(F,k,a,b,c,d,e,t) SHA1_VR(F,k,e,a,b,c,d,t+1) SHA1_VR(F,k,d,e,a,b,c,t+2) \
+	SHA1_VR(F,k,c,d,e,a,b,t+3) SHA1_VR(F,k,b,c,d,e,a,t+4)
+#define SHA1_VROUNDS \
+	SHA1_VR5(SHA1_V_F1, k0,  0) SHA1_VR5(SHA1_V_F1, k0,  5) SHA1_VR5(SHA1_V_F1, k0, 10) SHA1_VR5(SHA1_V_F1, k0, 15) \
+	SHA1_VR5(SHA1_V_F2, k1, 20) SHA1_VR5(SHA1_V_F2, k1, 25) SHA1_VR5(SHA1_V_F2, k1, 30) SHA1_VR5(SHA1_V_F2, k1, 35) \
+	SHA1_VR5(SHA1_V_F3, k2, 40) SHA1_VR5(SHA1_V_F3, k2, 45) SHA1_VR5(SHA1_V_F3, k2, 50) SHA1_VR5(SHA1_V_F3, k2, 55) \
+	SHA1_VR5(SHA1_V_F2, k3, 60) SHA1_VR5(SHA1_V_F2, k3, 65) SHA1_VR5(SHA1_V_F2, k3, 70) SHA1_VR5(SHA1_V_F2, k3, 75)
+
+#define SHA1_V_ADD(x, y) _mm256_add_epi32(x, y)
+#define SHA1_V_XOR(x, y) _mm256_xor_si256(x, y)
+#define SHA1_V_ROL(x, n) _mm256_or_si256(_mm256_slli_epi32(x, n), _mm256_srli_epi32(x, 32 - (n)))
+#define SHA1_V_F1(x, y, z) SHA1_V_XOR(_mm256_and_si256(x, SHA1_V_XOR(y, z)), z)
+#define SHA1_V_F2(x, y, z) SHA1_V_XOR(SHA1_V_XOR(x, y), z)
+#define SHA1_V_F3(x, y, z) _mm256_or_si256(_mm256_and_si256(x, y), _mm256_and_si256(_mm256_or_si256(x, y), z))
+#define SHA1_V_SCHED(w3, w8, w14, w16) SHA1_V_ROL(SHA1_V_XOR(SHA1_V_XOR(w3, w8), SHA1_V_XOR(w14, w16)), 1)
+
+__attribute__((target("avx2")))
+void SHA1_lanes_avx2(uint32_t state[40], const unsigned char* const blocks[8])
+{
+	const __m256i bswap = _mm256_set_epi8(12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3,
+	                                      12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3);
+	const __m256i k0 = _mm256_set1_epi32(0x5A827999);
+	const __m256i k1 = _mm256_set1_epi32(0x6ED9EBA1);
+	const __m256i k2 = _mm256_set1_epi32((int)0x8F1BBCDC);
+	const __m256i k3 = _mm256_set1_epi32((int)0xCA62C1D6);
+
+	/* the addresses of the blocks, word t of each one is a gather away */
+	const __m256i lo = _mm256_loadu_si256((const __m256i*)blocks);
+	const __m256i hi = _mm256_loadu_si256((const __m256i*)(blocks + 4));
+	__m256i m[16];
+
+	for (int t = 0; t < 16; t++)
+	{
+		__m256i off = _mm256_set1_epi64x(4 * t);
+		__m128i w0 = _mm256_i64gather_epi32((const int*)0, _mm256_add_epi64(lo, off), 1);
+		__m128i w1 = _mm256_i64gather_epi32((const int*)0, _mm256_add_epi64(hi, off), 1);
+
+		m[t] = _mm256_shuffle_epi8(_mm256_set_m128i(w1, w0), bswap);
+	}
+
+	__m256i a = _mm256_loadu_si256((const __m256i*)(state +  0));
+	__m256i b = _mm256_loadu_si256((const __m256i*)(state +  8));
+	__m256i c = _mm256_loadu_si256((const __m256i*)(state + 16));
+	__m256i d = _mm256_loadu_si256((const __m256i*)(state + 24));
+	__m256i e = _mm256_loadu_si256((const __m256i*)(state + 32));
+
+	SHA1_VROUNDS
+
+	_mm256_storeu_si256((__m256i*)(state +  0), _mm256_add_epi32(a, _mm256_loadu_si256((const __m256i*)(state +  0))));
+	_mm256_storeu_si256((__m256i*)(state +  8), _mm256_add_epi32(b, _mm256_loadu_si256((const __m256i*)(state +  8))));
+	_mm256_storeu_si256((__m256i*)(state + 16), _mm256_add_epi32(c, _mm256_loadu_si256((const __m256i*)(state + 16))));
+	_mm256_storeu_si256((__m256i*)(state + 24), _mm256_add_epi32(d, _mm256_loadu_si256((const __m256i*)(state + 24))));
+	_mm256_storeu_si256((__m256i*)(state + 32), _mm256_add_epi32(e, _mm256_loadu_si256((const __m256i*)(state + 32))));
+}
+
+#undef SHA1_V_ADD
+#undef SHA1_V_XOR
+#undef SHA1_V_ROL
+#undef SHA1_V_F1
+#undef SHA1_V_F2
+#undef SHA1_V_F3
+#undef SHA1_V_SCHED
+
+/* vpternlogd computes any function of three inputs in one go */
+#define SHA1_V_ADD(x, y) _mm512_add_epi32(x, y)
+#define SHA1_V_ROL(x, n) _mm512_rol_epi32(x, n)
+#define SHA1_V_F1(x, y, z) _mm512_ternarylogic_epi32(x, y, z, 0xCA)
+#define SHA1_V_F2(x, y, z) _mm512_ternarylogic_epi32(x, y, z, 0x96)
+#define SHA1_V_F3(x, y, z) _mm512_ternarylogic_epi32(x, y, z, 0xE8)
+#define SHA1_V_SCHED(w3, w8, w14, w16) SHA1_V_ROL(_mm512_xor_si512(SHA1_V_F2(w3, w8, w14), w16), 1)
+
+__attribute__((target("avx512f")))
+void SHA1_lanes_avx512(uint32_t state[80], const unsigned char* const blocks[16])
+{
+	const __m512i k0 = _mm512_set1_epi32(0x5A827999);
+	const __m512i k1 = _mm512_set1_epi32(0x6ED9EBA1);
+	const __m512i k2 = _mm512_set1_epi32((int)0x8F1BBCDC);
+	const __m512i k3 = _mm512_set1_epi32((int)0xCA62C1D6);
+	const __m512i even = _mm512_set1_epi32(0x00FF00FF);
+
+	const __m512i lo = _mm512_loadu_si512((const void*)blocks);
+	const __m512i hi = _mm512_loadu_si512((const void*)(blocks + 8));
+	__m512i m[16];
+
+	for (int t = 0; t < 16; t++)
+	{
+		__m512i off = _mm512_set1_epi64(4 * t);
+		__m256i w0 = _mm512_i64gather_epi32(_mm512_add_epi64(lo, off), (const void*)0, 1);
+		__m256i w1 = _mm512_i64gather_epi32(_mm512_add_epi64(hi, off), (const void*)0, 1);
+		__m512i w = _mm512_inserti64x4(_mm512_castsi256_si512(w0), w1, 1);
+
+		/* byte swap as in blk0(), without AVX512BW for a byte shuffle */
+		m[t] = _mm512_ternarylogic_epi32(_mm512_rol_epi32(w, 8), _mm512_rol_epi32(w, 24), even, 0xE4);
+	}
+
+	__m512i a = _mm512_loadu_si512((const void*)(state +  0));
+	__m512i b = _mm512_loadu_si512((const void*)(state + 16));
+	__m512i c = _mm512_loadu_si512((const void*)(state + 32));
+	__m512i d = _mm512_loadu_si512((const void*)(state + 48));
+	__m512i e = _mm512_loadu_si512((const void*)(state + 64));
+
+	SHA1_VROUNDS
+
+	_mm512_storeu_si512((void*)(state +  0), _mm512_add_epi32(a, _mm512_loadu_si512((const void*)(state +  0))));
+	_mm512_storeu_si512((void*)(state + 16), _mm512_add_epi32(b, _mm512_loadu_si512((const void*)(state + 16))));
+	_mm512_storeu_si512((void*)(state + 32), _mm512_add_epi32(c, _mm512_loadu_si512((const void*)(state + 32))));
+	_mm512_storeu_si512((void*)(state + 48), _mm512_add_epi32(d, _mm512_loadu_si512((const void*)(state + 48))));
+	_mm512_storeu_si512((void*)(state + 64), _mm512_add_epi32(e, _mm512_loadu_si512((const void*)(state + 64))));
+}
+#endif
+
+void SHA1_blocks(uint32_t state[5], const unsigned char* data, size_t blocks)
+{
+#ifdef SHA1_HAVE_X86
+	/* libgcc checks the CPU once, at startup */
+	if (__builtin_cpu_supports("sha") && __builtin_cpu_supports("sse4.1"))
+	{
+		SHA1_blocks_shani(state, data, blocks);
+		return;
+	}
+
+	if (__builtin_cpu_supports("ssse3"))
+	{
+		SHA1_blocks_ssse3(state, data, blocks);
+		return;
+	}
+#endif
+
+	SHA1_blocks_generic(state, data, blocks);
+}
+
 /* SHA1Init - Initialize new context */
 void SHA1_reset(SHA1_CTX* context)
 {
@@ -240,7 +572,7 @@ void SHA1_reset(SHA1_CTX* context)
 /* Run your data through this. */
 void SHA1_input(SHA1_CTX* context, const unsigned char* data, size_t len)
 {
-	uint32_t i = 0;
+	size_t i = 0;
 	uint32_t j = context->count[0];
 
 	if ((context->count[0] += len << 3) < j)
@@ -252,10 +584,11 @@ void SHA1_input(SHA1_CTX* context, const unsigned char* data, size_t len)
 	if ((j + len) > 63)
 	{
 		memcpy(&context->buffer[j], data, (i = 64 - j));
-		SHA1_transform(context->state, context->buffer);
+		SHA1_blocks(context->state, context->buffer, 1);
 
-		for (; i + 63 < len; i += 64)
-			SHA1_transform(context->state, &data[i]);
+		/* and every whole block of the data in one go */
+		SHA1_blocks(context->state, &data[i], (len - i) / 64);
+		i += (len - i) / 64 * 64;
 
 		j = 0;
 	}
@@ -297,5 +630,143 @@ void SHA1(SHA1_t digest, const unsigned char* data, size_t len)
 	SHA1_result(&ctx, digest);
 }
 
+#ifdef SHA1_HAVE_X86
+/* One block of each lane per call, see SHA1_lanes_avx2() */
+typedef void (*SHA1_lanes_fn)(uint32_t* state, const unsigned char* const* blocks);
+
+/* A message in flight in one lane of SHA1_multi() */
+typedef struct
+{
+	const unsigned char* data; /* next block to hash */
+	size_t full;               /* whole blocks left in the message itself */
+	size_t blocks;             /* blocks left, the padding included */
+	size_t index;              /* position of the message in the batch */
+	unsigned char tail[128];   /* the last partial block of the message, padded */
+} SHA1_lane;
+
+static void SHA1_lane_start(SHA1_lane* lane, uint32_t* state, size_t lanes, const unsigned char* data, size_t len, size_t index)
+{
+	static const uint32_t iv[5] = { 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0 };
+	size_t rem = len & 63;
+	size_t pad = (rem < 56 ? 64 : 128);
+	uint64_t bits = (uint64_t)len << 3;
+
+	lane->full = len / 64;
+	lane->blocks = lane->full + pad / 64;
+	lane->data = (lane->full != 0 ? data : lane->tail);
+	lane->index = index;
+
+	/* the same padding SHA1_result() adds */
+	memset(lane->tail, 0, pad);
+	if (rem != 0)
+		memcpy(lane->tail, data + len - rem, rem);
+
+	lane->tail[rem] = 0200;
+	for (unsigned int i = 0; i < 8; i++)
+		lane->tail[pad - 1 - i] = (unsigned char)(bits >> (8 * i));
+
+	for (unsigned int i = 0; i < 5; i++)
+		state[i * lanes] = iv[i];
+}
+
+static void SHA1_lane_digest(const uint32_t* state, size_t lanes, SHA1_t digest)
+{
+	for (unsigned int i = 0; i < 20; i++)
+		digest[i] = (unsigned char)((state[(i >> 2) * lanes] >> ((3 - (i & 3)) * 8)) & 255);
+}
+
+static void SHA1_multi_lanes(SHA1_t* digests, const unsigned char* const* data, const size_t* lens, size_t count, size_t lanes, SHA1_lanes_fn fn)
+{
+	static const unsigned char idle[64] = { 0 };
+	const unsigned char* blocks[16];
+	uint32_t state[5 * 16];
+	SHA1_lane lane[16];
+	size_t next = 0, active = 0, l;
+
+	for (l = 0; l < lanes; l++)
+	{
+		lane[l].blocks = 0;
+
+		if (next < count)
+		{
+			SHA1_lane_start(&lane[l], state + l, lanes, data[next], lens[next], next);
+			next++;
+			active++;
+		}
+	}
+
+	/* Lanes are refilled as long as there are messages left, once the last ones
+	   start finishing it is faster to see the few remaining to the end alone */
+	while (active > lanes / 4)
+	{
+		for (l = 0; l < lanes; l++)
+			blocks[l] = (lane[l].blocks != 0 ? lane[l].data : idle);
+
+		fn(state, blocks);
+
+		for (l = 0; l < lanes; l++)
+		{
+			SHA1_lane* s = &lane[l];
+
+			if (s->blocks == 0)
+				continue;
+
+			s->data += 64;
+			if (s->full != 0 && --s->full == 0)
+				s->data = s->tail;
+
+			if (--s->blocks != 0)
+				continue;
+
+			SHA1_lane_digest(state + l, lanes, digests[s->index]);
+
+			if (next < count)
+			{
+				SHA1_lane_start(s, state + l, lanes, data[next], lens[next], next);
+				next++;
+			}
+			else
+				active--;
+		}
+	}
+
+	for (l = 0; l < lanes; l++)
+	{
+		SHA1_lane* s = &lane[l];
+		uint32_t st[5];
+
+		if (s->blocks == 0)
+			continue;
+
+		for (unsigned int i = 0; i < 5; i++)
+			st[i] = state[i * lanes + l];
+
+		SHA1_blocks(st, s->data, s->full);
+		SHA1_blocks(st, (s->full != 0 ? s->tail : s->data), s->blocks - s->full);
+		SHA1_lane_digest(st, 1, digests[s->index]);
+	}
+}
+#endif
+
+void SHA1_multi(SHA1_t* digests, const unsigned char* const* data, const size_t* lens, size_t count)
+{
+#ifdef SHA1_HAVE_X86
+	if (__builtin_cpu_supports("avx512f"))
+	{
+		SHA1_multi_lanes(digests, data, lens, count, 16, SHA1_lanes_avx512);
+		return;
+	}
+
+	if (__builtin_cpu_supports("avx2"))
+	{
+		SHA1_multi_lanes(digests, data, lens, count, 8, SHA1_lanes_avx2);
+		return;
+	}
+#endif
+
+	for (size_t i = 0; i < count; i++)
+		SHA1(digests[i], data[i], lens[i]);
+}
+
 #endif // SHA1_IMPLEMENTATION
 #endif // __SHA1_H__